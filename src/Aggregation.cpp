@@ -0,0 +1,153 @@
+/** @file Aggregation.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Aggregation.h"
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+/**
+ * Constructor
+ * @param kind Computed value
+ * @param match Payload counted by COUNT_MATCHING
+ */
+Aggregation::Aggregation(Kind kind, std::string match) : kind(kind), match(std::move(match)) {}
+
+/**
+ * Converts dashboard tile type to aggregation kind
+ * @param name Tile type name
+ * @param kind Output kind
+ * @return False if name is not an aggregation
+ */
+bool Aggregation::kind_from_name(const std::string& name, Kind& kind)
+{
+    if (name == "Average"){
+        kind = AVERAGE;
+    } else if (name == "Sum"){
+        kind = SUM;
+    } else if (name == "Minimum"){
+        kind = MINIMUM;
+    } else if (name == "Maximum"){
+        kind = MAXIMUM;
+    } else if (name == "Count matching"){
+        kind = COUNT_MATCHING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Parses whole payload as a number, surrounding white space is allowed
+ * @param payload Message payload
+ * @param value Output number
+ * @return False if payload is not a finite number, NaN would break ordering of values
+ */
+static bool parse_number(const std::string& payload, double& value)
+{
+    const char* start = payload.c_str();
+    char* end;
+    value = strtod(start, &end);
+    if (end == start){
+        return false;
+    }
+    while (isspace(static_cast<unsigned char>(*end))){
+        end++;
+    }
+    return end == start + payload.size() && std::isfinite(value);
+}
+
+/**
+ * Replaces contribution of topic with its new payload
+ * @param topic Full topic name
+ * @param payload Latest payload of topic
+ * @return True if aggregated value may have changed
+ */
+bool Aggregation::update(const std::string& topic, const std::string& payload)
+{
+    Source next;
+    if (kind == COUNT_MATCHING){
+        next.matching = payload == match;
+    } else {
+        next.numeric = parse_number(payload, next.value);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Source& source = sources[topic];
+    if (source.numeric == next.numeric && source.matching == next.matching && source.value == next.value){
+        return false;
+    }
+    if (source.numeric){
+        sum -= source.value;
+        numeric--;
+        if (kind == MINIMUM || kind == MAXIMUM){
+            values.erase(values.find(source.value));
+        }
+    }
+    if (source.matching){
+        matching--;
+    }
+    source = next;
+    if (source.numeric){
+        sum += source.value;
+        numeric++;
+        if (kind == MINIMUM || kind == MAXIMUM){
+            values.insert(source.value);
+        }
+    }
+    if (source.matching){
+        matching++;
+    }
+    if (numeric == 0){
+        // Drop accumulated rounding error
+        sum = 0;
+    }
+    return true;
+}
+
+/**
+ * Computes current value
+ * @param result Output value
+ * @return False if no matching topic has a numeric payload
+ */
+bool Aggregation::value(double& result) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    switch (kind){
+        case COUNT_MATCHING:
+            result = matching;
+            return true;
+        case SUM:
+            result = sum;
+            return numeric > 0;
+        case AVERAGE:
+            if (numeric == 0){
+                return false;
+            }
+            result = sum / numeric;
+            return true;
+        case MINIMUM:
+            if (values.empty()){
+                return false;
+            }
+            result = *values.begin();
+            return true;
+        case MAXIMUM:
+            if (values.empty()){
+                return false;
+            }
+            result = *values.rbegin();
+            return true;
+    }
+    return false;
+}
+
+/** @return Number of matching topics seen */
+size_t Aggregation::topics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return sources.size();
+}
@@ -0,0 +1,49 @@
+/** @file Aggregation.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Value computed over latest payloads of all topics matching a wildcard filter.
+ * Each update replaces contribution of one topic, so the value is maintained incrementally
+ * without visiting other topics.
+ */
+class Aggregation{
+public:
+    enum Kind{
+        AVERAGE,
+        SUM,
+        MINIMUM,
+        MAXIMUM,
+        COUNT_MATCHING  ///< Number of topics whose latest payload equals the match string
+    };
+
+    Aggregation(Kind kind, std::string match);
+    static bool kind_from_name(const std::string& name, Kind& kind);
+    bool update(const std::string& topic, const std::string& payload);
+    bool value(double& result) const;
+    size_t topics() const;
+
+private:
+    /** Contribution of one topic */
+    struct Source{
+        bool numeric = false;
+        bool matching = false;
+        double value = 0;
+    };
+
+    Kind kind;
+    std::string match;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Source> sources;
+    std::multiset<double> values;  ///< Numeric values, kept only for minimum and maximum
+    double sum = 0;
+    size_t numeric = 0;
+    size_t matching = 0;
+};
@@ -0,0 +1,1022 @@
+/** @file Broker.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Broker.h"
+#include "Topicfilter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+/** Control packet types */
+enum PacketType : uint8_t{
+    CONNECT = 1, CONNACK, PUBLISH, PUBACK, PUBREC, PUBREL, PUBCOMP, SUBSCRIBE, SUBACK,
+    UNSUBSCRIBE, UNSUBACK, PINGREQ, PINGRESP, DISCONNECT, AUTH
+};
+
+/** MQTT 5 properties handled by the broker */
+const uint8_t SUBSCRIPTION_IDENTIFIER = 0x0B;
+const uint8_t ASSIGNED_CLIENT_IDENTIFIER = 0x12;
+const uint8_t TOPIC_ALIAS_MAXIMUM = 0x22;
+const uint8_t TOPIC_ALIAS = 0x23;
+const uint8_t MAXIMUM_QOS = 0x24;
+const uint8_t SHARED_SUBSCRIPTION_AVAILABLE = 0x2A;
+
+/** Bytes read from one client before other clients are served */
+const size_t READ_LIMIT = 1024 * 1024;
+
+/** Cursor over packet body, reading past the end clears ok and returns zeros */
+struct Reader{
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    Reader(const uint8_t* p, const uint8_t* end) : p(p), end(end) {}
+    size_t left() const { return end - p; }
+    bool has(size_t n)
+    {
+        ok = ok && left() >= n;
+        return ok;
+    }
+    uint8_t byte()
+    {
+        return has(1) ? *p++ : 0;
+    }
+    uint16_t u16()
+    {
+        if (!has(2)){
+            return 0;
+        }
+        uint16_t value = static_cast<uint16_t>(p[0] << 8 | p[1]);
+        p += 2;
+        return value;
+    }
+    uint32_t varint()
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4 && ok; i++){
+            uint8_t b = byte();
+            value |= uint32_t(b & 0x7f) << (7 * i);
+            if (!(b & 0x80)){
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+    std::string string()
+    {
+        uint16_t size = u16();
+        if (!has(size)){
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char*>(p), size);
+        p += size;
+        return value;
+    }
+    void skip(size_t n)
+    {
+        if (has(n)){
+            p += n;
+        }
+    }
+    /** @return Reader over MQTT 5 property block, the block is skipped */
+    Reader properties()
+    {
+        uint32_t size = varint();
+        if (!has(size)){
+            return Reader(p, p);
+        }
+        Reader block(p, p + size);
+        p += size;
+        return block;
+    }
+};
+
+/**
+ * Reads one MQTT 5 property
+ * @param properties Reader over property block, ok is cleared on malformed property
+ * @param value Output reader over value of the property
+ * @return Property identifier, 0 at the end of the block or on malformed property
+ */
+uint8_t next_property(Reader& properties, Reader& value)
+{
+    if (!properties.ok || properties.left() == 0){
+        return 0;
+    }
+    uint32_t id = properties.varint();
+    const uint8_t* start = properties.p;
+    switch (id){
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+        properties.skip(1);
+        break;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+        properties.skip(2);
+        break;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+        properties.skip(4);
+        break;
+    case 0x0B:
+        properties.varint();
+        break;
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+        properties.skip(properties.u16());
+        break;
+    case 0x26:
+        // User property, string pair
+        properties.skip(properties.u16());
+        properties.skip(properties.u16());
+        break;
+    default:
+        properties.ok = false;
+    }
+    if (!properties.ok){
+        return 0;
+    }
+    value = Reader(start, properties.p);
+    return static_cast<uint8_t>(id);
+}
+
+void put_u16(std::string& out, uint16_t value)
+{
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void put_varint(std::string& out, size_t value)
+{
+    do {
+        uint8_t b = value & 0x7f;
+        value >>= 7;
+        out += static_cast<char>(value > 0 ? b | 0x80 : b);
+    } while (value > 0);
+}
+
+void put_string(std::string& out, const std::string& value)
+{
+    put_u16(out, static_cast<uint16_t>(value.size()));
+    out += value;
+}
+
+/**
+ * Checks topic filter syntax
+ * @param filter Topic filter
+ * @return True if wildcards occupy whole levels and # is the last level
+ */
+bool valid_filter(const std::string& filter)
+{
+    if (filter.empty()){
+        return false;
+    }
+    for (size_t i = 0; i < filter.size(); i++){
+        char c = filter[i];
+        if (c != '+' && c != '#'){
+            continue;
+        }
+        bool whole_level = (i == 0 || filter[i - 1] == '/') && (i + 1 == filter.size() || filter[i + 1] == '/');
+        if (!whole_level || (c == '#' && i + 1 != filter.size())){
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+/** Connection of one client */
+struct Broker::Client{
+    int fd;
+    int version = 0;  ///< Protocol level, 0 until CONNECT
+    std::string id;
+    std::string in;
+    std::string out;
+    size_t out_pos = 0;  ///< Bytes of out already written
+    bool closed = false;
+    bool pending = false;  ///< Listed in pending for flush
+    uint16_t next_packet_id = 1;
+    std::unordered_map<uint16_t, std::string> aliases;
+    std::unordered_set<std::string> filters;
+
+    explicit Client(int fd) : fd(fd) {}
+};
+
+/** Level of filter tree, children are keyed by filter level including + and # */
+struct Broker::Node{
+    std::unordered_map<std::string, std::unique_ptr<Node>> children;
+    std::vector<Subscription> subscriptions;
+};
+
+Broker::Broker() = default;
+
+Broker::~Broker()
+{
+    stop();
+}
+
+/**
+ * Starts listening and serving clients in a background thread
+ * @param address Listening address, empty for all interfaces
+ * @param port Listening port, 0 picks a free port
+ * @throw std::runtime_error If the socket cannot be opened
+ */
+void Broker::start(const std::string& address, uint16_t port)
+{
+    stop();
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo* result = nullptr;
+    int error = getaddrinfo(address.empty() ? nullptr : address.c_str(), std::to_string(port).c_str(), &hints, &result);
+    if (error != 0){
+        throw std::runtime_error("Cannot resolve " + address + ": " + gai_strerror(error));
+    }
+    int fd = -1;
+    int last_errno = 0;
+    for (addrinfo* it = result; it != nullptr && fd < 0; it = it->ai_next){
+        fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+        if (fd < 0){
+            last_errno = errno;
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, it->ai_addr, it->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0){
+            last_errno = errno;
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd < 0){
+        throw std::runtime_error("Cannot listen on " + address + ":" + std::to_string(port) + ": " + strerror(last_errno));
+    }
+    if (pipe(wake_pipe) != 0){
+        ::close(fd);
+        throw std::runtime_error(std::string("Cannot create pipe: ") + strerror(errno));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    sockaddr_storage bound{};
+    socklen_t bound_size = sizeof(bound);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &bound_size);
+    bound_port = ntohs(bound.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                                   : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+    listen_fd = fd;
+    root.reset(new Node);
+    retained_messages.clear();
+    for (auto counter: {&connections, &total_connections, &received, &received_bytes, &sent, &sent_bytes,
+                        &received_wire_bytes, &sent_wire_bytes, &dropped, &subscription_count, &retained_count}){
+        *counter = 0;
+    }
+    running = true;
+    loop = std::thread(&Broker::run, this);
+}
+
+/**
+ * Stops the event loop and disconnects all clients
+ */
+void Broker::stop()
+{
+    if (!loop.joinable()){
+        return;
+    }
+    running = false;
+    ssize_t written = write(wake_pipe[1], "", 1);
+    (void)written;
+    loop.join();
+    for (auto& client: clients){
+        close_client(*client);
+    }
+    clients.clear();
+    pending.clear();
+    ::close(listen_fd);
+    ::close(wake_pipe[0]);
+    ::close(wake_pipe[1]);
+    listen_fd = -1;
+    wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+/** @return Listening port, useful after starting on port 0 */
+uint16_t Broker::port() const
+{
+    return bound_port;
+}
+
+/** @return Current values of traffic counters */
+BrokerStats Broker::stats() const
+{
+    BrokerStats stats;
+    stats.connections = connections;
+    stats.total_connections = total_connections;
+    stats.received = received;
+    stats.received_bytes = received_bytes;
+    stats.sent = sent;
+    stats.sent_bytes = sent_bytes;
+    stats.received_wire_bytes = received_wire_bytes;
+    stats.sent_wire_bytes = sent_wire_bytes;
+    stats.dropped = dropped;
+    stats.subscriptions = subscription_count;
+    stats.retained = retained_count;
+    return stats;
+}
+
+/**
+ * Event loop, waits for socket events, handles received packets and writes queued output
+ */
+void Broker::run()
+{
+    std::vector<pollfd> fds;
+    std::vector<Client*> polled;
+    while (running){
+        fds.clear();
+        polled.clear();
+        fds.push_back({wake_pipe[0], POLLIN, 0});
+        fds.push_back({listen_fd, POLLIN, 0});
+        for (auto& client: clients){
+            short events = POLLIN;
+            if (client->out_pos < client->out.size()){
+                events |= POLLOUT;
+            }
+            fds.push_back({client->fd, events, 0});
+            polled.push_back(client.get());
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents != 0){
+            // Woken by stop
+            continue;
+        }
+        if (fds[1].revents & POLLIN){
+            accept_clients();
+        }
+        for (size_t i = 0; i < polled.size(); i++){
+            Client& client = *polled[i];
+            short events = fds[i + 2].revents;
+            if (client.closed || events == 0){
+                continue;
+            }
+            if ((events & (POLLERR | POLLNVAL)) || ((events & (POLLIN | POLLHUP)) && !read_client(client))){
+                close_client(client);
+                continue;
+            }
+            if ((events & POLLOUT) && !client.pending){
+                client.pending = true;
+                pending.push_back(&client);
+            }
+        }
+        for (Client* client: pending){
+            client->pending = false;
+            if (!client->closed){
+                flush(*client);
+            }
+        }
+        pending.clear();
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const std::unique_ptr<Client>& client){
+            return client->closed;
+        }), clients.end());
+    }
+}
+
+/**
+ * Accepts all waiting connections
+ */
+void Broker::accept_clients()
+{
+    while (true){
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0){
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        clients.emplace_back(new Client(fd));
+    }
+}
+
+/**
+ * Reads available data of client and handles all complete packets
+ * @param client Readable client
+ * @return False if the connection was closed or violated the protocol
+ */
+bool Broker::read_client(Client& client)
+{
+    char buffer[65536];
+    size_t total = 0;
+    while (total < READ_LIMIT){
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n > 0){
+            client.in.append(buffer, n);
+            total += n;
+        } else if (n == 0){
+            return false;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK){
+            break;
+        } else if (errno != EINTR){
+            return false;
+        }
+    }
+    received_wire_bytes += total;
+
+    size_t pos = 0;
+    auto data = reinterpret_cast<const uint8_t*>(client.in.data());
+    while (client.in.size() - pos >= 2){
+        Reader length_reader(data + pos + 1, data + std::min(client.in.size(), pos + 5));
+        uint32_t length = length_reader.varint();
+        if (!length_reader.ok){
+            if (length_reader.left() == 0 && client.in.size() < pos + 5){
+                // Remaining length not received yet
+                break;
+            }
+            return false;
+        }
+        size_t body = length_reader.p - data;
+        if (client.in.size() - body < length){
+            break;
+        }
+        if (!handle(client, data[pos], data + body, length) || client.closed){
+            return false;
+        }
+        pos = body + length;
+    }
+    client.in.erase(0, pos);
+    return true;
+}
+
+/**
+ * Writes queued output of client without blocking
+ * @param client Client with output
+ */
+void Broker::flush(Client& client)
+{
+    while (client.out_pos < client.out.size()){
+        ssize_t n = send(client.fd, client.out.data() + client.out_pos, client.out.size() - client.out_pos, MSG_NOSIGNAL);
+        if (n > 0){
+            client.out_pos += n;
+            sent_wire_bytes += n;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK){
+            break;
+        } else if (errno != EINTR){
+            close_client(client);
+            return;
+        }
+    }
+    if (client.out_pos == client.out.size()){
+        client.out.clear();
+        client.out_pos = 0;
+    } else if (client.out_pos > client.out.size() / 2){
+        client.out.erase(0, client.out_pos);
+        client.out_pos = 0;
+    }
+}
+
+/**
+ * Closes connection after writing what can be written and removes subscriptions of client,
+ * the client is destroyed at the end of event loop iteration
+ * @param client Client to close
+ */
+void Broker::close_client(Client& client)
+{
+    if (client.closed){
+        return;
+    }
+    client.closed = true;
+    while (client.out_pos < client.out.size()){
+        ssize_t n = send(client.fd, client.out.data() + client.out_pos, client.out.size() - client.out_pos, MSG_NOSIGNAL);
+        if (n <= 0){
+            break;
+        }
+        client.out_pos += n;
+        sent_wire_bytes += n;
+    }
+    ::close(client.fd);
+    for (const auto& filter: client.filters){
+        unsubscribe(filter, &client);
+    }
+    client.filters.clear();
+    if (client.version != 0){
+        connections--;
+    }
+    auto it = clients_by_id.find(client.id);
+    if (it != clients_by_id.end() && it->second == &client){
+        clients_by_id.erase(it);
+    }
+}
+
+/**
+ * Appends control packet to output of client
+ * @param client Receiving client
+ * @param type Packet type
+ * @param body Variable header and payload
+ */
+void Broker::queue(Client& client, uint8_t type, const std::string& body)
+{
+    client.out += static_cast<char>(type << 4);
+    put_varint(client.out, body.size());
+    client.out += body;
+    if (!client.pending){
+        client.pending = true;
+        pending.push_back(&client);
+    }
+}
+
+/**
+ * Handles one received packet
+ * @param client Sending client
+ * @param fixed First byte of fixed header
+ * @param body Packet after fixed header
+ * @param length Size of body
+ * @return False if the connection has to be closed
+ */
+bool Broker::handle(Client& client, uint8_t fixed, const uint8_t* body, size_t length)
+{
+    uint8_t type = fixed >> 4;
+    if (type == CONNECT){
+        return on_connect(client, body, length);
+    }
+    if (client.version == 0){
+        return false;
+    }
+    switch (type){
+    case PUBLISH:
+        return on_publish(client, fixed & 0x0f, body, length);
+    case PUBACK:
+        // Messages are not retransmitted, nothing waits for acknowledgement
+        return true;
+    case SUBSCRIBE:
+        return on_subscribe(client, body, length);
+    case UNSUBSCRIBE:
+        return on_unsubscribe(client, body, length);
+    case PINGREQ:
+        queue(client, PINGRESP, std::string());
+        return true;
+    default:
+        // DISCONNECT, QoS 2 flow and AUTH end the connection
+        return false;
+    }
+}
+
+/**
+ * Handles CONNECT, a newer connection with the same client identifier replaces the older one
+ * @return False if the connection has to be closed
+ */
+bool Broker::on_connect(Client& client, const uint8_t* body, size_t length)
+{
+    Reader r(body, body + length);
+    if (client.version != 0){
+        return false;
+    }
+    std::string protocol = r.string();
+    uint8_t level = r.byte();
+    uint8_t flags = r.byte();
+    r.u16();  // Keep alive is not enforced
+    if (!r.ok || (protocol != "MQTT" && protocol != "MQIsdp")){
+        return false;
+    }
+    if (level < 3 || level > 5){
+        // Unacceptable protocol version
+        queue(client, CONNACK, std::string("\0\x01", 2));
+        return false;
+    }
+    if (level == 5){
+        r.properties();
+    }
+    std::string id = r.string();
+    if (flags & 0x04){
+        // Will message is read but never published
+        if (level == 5){
+            r.properties();
+        }
+        r.string();
+        r.string();
+    }
+    if (flags & 0x80){
+        r.string();
+    }
+    if (flags & 0x40){
+        r.string();
+    }
+    if (!r.ok){
+        return false;
+    }
+    bool assigned = id.empty();
+    if (assigned){
+        id = "loopback-" + std::to_string(++assigned_ids);
+    }
+    auto existing = clients_by_id.find(id);
+    if (existing != clients_by_id.end()){
+        close_client(*existing->second);
+    }
+    client.version = level;
+    client.id = id;
+    clients_by_id[id] = &client;
+    connections++;
+    total_connections++;
+
+    std::string ack("\0\0", 2);  // Session not present, accepted
+    if (level == 5){
+        std::string properties;
+        properties += static_cast<char>(TOPIC_ALIAS_MAXIMUM);
+        put_u16(properties, topic_alias_maximum);
+        properties += static_cast<char>(MAXIMUM_QOS);
+        properties += '\x01';
+        properties += static_cast<char>(SHARED_SUBSCRIPTION_AVAILABLE);
+        properties += '\x00';
+        if (assigned){
+            properties += static_cast<char>(ASSIGNED_CLIENT_IDENTIFIER);
+            put_string(properties, id);
+        }
+        put_varint(ack, properties.size());
+        ack += properties;
+    }
+    queue(client, CONNACK, ack);
+    return true;
+}
+
+/**
+ * Handles PUBLISH, acknowledges QoS 1, stores retained message and delivers it to subscribers
+ * @return False if the connection has to be closed
+ */
+bool Broker::on_publish(Client& client, uint8_t flags, const uint8_t* body, size_t length)
+{
+    Reader r(body, body + length);
+    int qos = (flags >> 1) & 3;
+    bool retain = flags & 1;
+    if (qos > 1){
+        return false;
+    }
+    std::string topic = r.string();
+    uint16_t packet_id = qos > 0 ? r.u16() : 0;
+    std::string properties;
+    if (client.version == 5){
+        // Properties other than topic alias and subscription identifier are forwarded
+        Reader block = r.properties();
+        Reader value(nullptr, nullptr);
+        while (true){
+            const uint8_t* start = block.p;
+            uint8_t id = next_property(block, value);
+            if (id == 0){
+                break;
+            }
+            if (id == TOPIC_ALIAS){
+                uint16_t alias = value.u16();
+                if (alias == 0 || alias > topic_alias_maximum){
+                    return false;
+                }
+                if (topic.empty()){
+                    auto it = client.aliases.find(alias);
+                    if (it == client.aliases.end()){
+                        return false;
+                    }
+                    topic = it->second;
+                } else {
+                    client.aliases[alias] = topic;
+                }
+            } else if (id != SUBSCRIPTION_IDENTIFIER){
+                properties.append(reinterpret_cast<const char*>(start), block.p - start);
+            }
+        }
+        if (!block.ok){
+            return false;
+        }
+    }
+    if (!r.ok || topic.empty() || topic.find_first_of("+#") != std::string::npos){
+        return false;
+    }
+    const char* payload = reinterpret_cast<const char*>(r.p);
+    size_t size = r.left();
+    received++;
+    received_bytes += size;
+
+    if (qos == 1){
+        std::string ack;
+        put_u16(ack, packet_id);
+        queue(client, PUBACK, ack);
+    }
+    if (retain){
+        if (size == 0){
+            retained_messages.erase(topic);
+        } else {
+            retained_messages[topic] = Retained{std::string(payload, size), qos, properties};
+        }
+        retained_count = retained_messages.size();
+    }
+    deliver(client, topic, payload, size, qos, properties);
+    return true;
+}
+
+/**
+ * Handles SUBSCRIBE, retained messages matching new filters are sent after SUBACK
+ * @return False if the connection has to be closed
+ */
+bool Broker::on_subscribe(Client& client, const uint8_t* body, size_t length)
+{
+    Reader r(body, body + length);
+    uint16_t packet_id = r.u16();
+    uint32_t subscription_id = 0;
+    if (client.version == 5){
+        Reader block = r.properties();
+        Reader value(nullptr, nullptr);
+        while (uint8_t id = next_property(block, value)){
+            if (id == SUBSCRIPTION_IDENTIFIER){
+                subscription_id = value.varint();
+            }
+        }
+        if (!block.ok){
+            return false;
+        }
+    }
+    std::string codes;
+    std::vector<std::pair<std::string, int>> retained_filters;
+    do {
+        std::string filter = r.string();
+        uint8_t options = r.byte();
+        if (!r.ok){
+            return false;
+        }
+        if (!valid_filter(filter) || filter.compare(0, 7, "$share/") == 0){
+            // Shared subscriptions are not supported
+            codes += static_cast<char>(client.version == 5 && valid_filter(filter) ? 0x9E : 0x80);
+            continue;
+        }
+        int qos = std::min(options & 3, 1);
+        bool existed = !client.filters.insert(filter).second;
+        bool no_local = client.version == 5 && (options & 0x04);
+        subscribe(filter, Subscription{&client, qos, no_local, client.version == 5 ? subscription_id : 0});
+        codes += static_cast<char>(qos);
+        int retain_handling = client.version == 5 ? (options >> 4) & 3 : 0;
+        if (retain_handling == 0 || (retain_handling == 1 && !existed)){
+            retained_filters.emplace_back(filter, qos);
+        }
+    } while (r.left() > 0);
+
+    std::string ack;
+    put_u16(ack, packet_id);
+    if (client.version == 5){
+        ack += '\0';
+    }
+    ack += codes;
+    queue(client, SUBACK, ack);
+
+    std::vector<uint32_t> retained_ids;
+    if (client.version == 5 && subscription_id != 0){
+        retained_ids.push_back(subscription_id);
+    }
+    for (const auto& filter: retained_filters){
+        for (const auto& it: retained_messages){
+            if (topic_matches(filter.first, it.first)){
+                send_publish(client, it.first, it.second.payload.data(), it.second.payload.size(),
+                             std::min(it.second.qos, filter.second), true, it.second.properties, retained_ids);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Handles UNSUBSCRIBE
+ * @return False if the connection has to be closed
+ */
+bool Broker::on_unsubscribe(Client& client, const uint8_t* body, size_t length)
+{
+    Reader r(body, body + length);
+    uint16_t packet_id = r.u16();
+    if (client.version == 5){
+        r.properties();
+    }
+    std::string codes;
+    do {
+        std::string filter = r.string();
+        if (!r.ok){
+            return false;
+        }
+        bool existed = client.filters.erase(filter) > 0;
+        if (existed){
+            unsubscribe(filter, &client);
+        }
+        // Success or no subscription existed
+        codes += static_cast<char>(existed ? 0x00 : 0x11);
+    } while (r.left() > 0);
+
+    std::string ack;
+    put_u16(ack, packet_id);
+    if (client.version == 5){
+        ack += '\0';
+        ack += codes;
+    }
+    queue(client, UNSUBACK, ack);
+    return true;
+}
+
+/**
+ * Sends message to every client with matching subscription, once per client with the highest granted QoS
+ * and identifiers of all its matching subscriptions
+ * @param sender Publishing client, skipped by its no local subscriptions
+ * @param topic Topic of message
+ * @param payload Payload of message
+ * @param size Size of payload
+ * @param qos Quality of service of the publication
+ * @param properties Encoded MQTT 5 properties forwarded to subscribers
+ */
+void Broker::deliver(const Client& sender, const std::string& topic, const char* payload, size_t size,
+                     int qos, const std::string& properties)
+{
+    split(topic);
+    matches.clear();
+    match(*root, 0, topic[0] == '$');
+    if (matches.empty()){
+        return;
+    }
+    std::sort(matches.begin(), matches.end(), [](const Subscription& a, const Subscription& b){
+        return std::less<Client*>()(a.client, b.client);
+    });
+    for (size_t i = 0; i < matches.size();){
+        Client* target = matches[i].client;
+        int granted = -1;
+        ids.clear();
+        for (; i < matches.size() && matches[i].client == target; i++){
+            if (matches[i].no_local && target == &sender){
+                continue;
+            }
+            granted = std::max(granted, matches[i].qos);
+            if (matches[i].id != 0){
+                ids.push_back(matches[i].id);
+            }
+        }
+        if (granted >= 0 && !target->closed){
+            send_publish(*target, topic, payload, size, std::min(qos, granted), false, properties, ids);
+        }
+    }
+}
+
+/**
+ * Appends PUBLISH packet to output of client, the message is dropped if the output is full
+ * @param client Receiving client
+ * @param topic Topic of message
+ * @param payload Payload of message
+ * @param size Size of payload
+ * @param qos Quality of service of delivery
+ * @param retain Retain flag, set only for retained messages sent after subscribing
+ * @param properties Encoded MQTT 5 properties of message
+ * @param subscription_ids Identifiers of matching subscriptions of the client
+ */
+void Broker::send_publish(Client& client, const std::string& topic, const char* payload, size_t size, int qos,
+                          bool retain, const std::string& properties, const std::vector<uint32_t>& subscription_ids)
+{
+    if (client.out.size() - client.out_pos > max_queued){
+        dropped++;
+        return;
+    }
+    header.clear();
+    put_string(header, topic);
+    if (qos > 0){
+        put_u16(header, client.next_packet_id);
+        if (++client.next_packet_id == 0){
+            client.next_packet_id = 1;
+        }
+    }
+    if (client.version == 5){
+        size_t ids_size = 0;
+        for (uint32_t id: subscription_ids){
+            ids_size += 1 + (id < 0x80 ? 1 : id < 0x4000 ? 2 : id < 0x200000 ? 3 : 4);
+        }
+        put_varint(header, properties.size() + ids_size);
+        header += properties;
+        for (uint32_t id: subscription_ids){
+            header += static_cast<char>(SUBSCRIPTION_IDENTIFIER);
+            put_varint(header, id);
+        }
+    }
+    client.out += static_cast<char>(PUBLISH << 4 | qos << 1 | (retain ? 1 : 0));
+    put_varint(client.out, header.size() + size);
+    client.out += header;
+    client.out.append(payload, size);
+    sent++;
+    sent_bytes += size;
+    if (!client.pending){
+        client.pending = true;
+        pending.push_back(&client);
+    }
+}
+
+/**
+ * Adds subscription to filter tree, replaces earlier subscription of the same client and filter
+ * @param filter Valid topic filter
+ * @param subscription Subscription of client
+ */
+void Broker::subscribe(const std::string& filter, const Subscription& subscription)
+{
+    split(filter);
+    Node* node = root.get();
+    for (const auto& level: levels){
+        auto& child = node->children[level];
+        if (!child){
+            child.reset(new Node);
+        }
+        node = child.get();
+    }
+    for (auto& it: node->subscriptions){
+        if (it.client == subscription.client){
+            it = subscription;
+            return;
+        }
+    }
+    node->subscriptions.push_back(subscription);
+    subscription_count++;
+}
+
+/**
+ * Removes subscription of client from filter tree together with levels left without subscriptions
+ * @param filter Subscribed topic filter
+ * @param client Subscribed client
+ */
+void Broker::unsubscribe(const std::string& filter, const Client* client)
+{
+    split(filter);
+    std::vector<Node*> path{root.get()};
+    for (const auto& level: levels){
+        auto it = path.back()->children.find(level);
+        if (it == path.back()->children.end()){
+            return;
+        }
+        path.push_back(it->second.get());
+    }
+    auto& subscriptions = path.back()->subscriptions;
+    auto it = std::remove_if(subscriptions.begin(), subscriptions.end(), [client](const Subscription& subscription){
+        return subscription.client == client;
+    });
+    subscription_count -= subscriptions.end() - it;
+    subscriptions.erase(it, subscriptions.end());
+    for (size_t i = levels.size(); i > 0; i--){
+        if (!path[i]->subscriptions.empty() || !path[i]->children.empty()){
+            break;
+        }
+        path[i - 1]->children.erase(levels[i - 1]);
+    }
+}
+
+/**
+ * Collects subscriptions of filters matching topic split into levels
+ * @param node Node of filter tree matching first level levels of topic
+ * @param level Index of next topic level
+ * @param system_topic Topic starts with $, wildcards at first level do not match it
+ */
+void Broker::match(const Node& node, size_t level, bool system_topic)
+{
+    bool wildcards = !(system_topic && level == 0);
+    if (wildcards){
+        // "a/#" also matches parent level "a"
+        auto all = node.children.find("#");
+        if (all != node.children.end()){
+            matches.insert(matches.end(), all->second->subscriptions.begin(), all->second->subscriptions.end());
+        }
+    }
+    if (level == levels.size()){
+        matches.insert(matches.end(), node.subscriptions.begin(), node.subscriptions.end());
+        return;
+    }
+    auto exact = node.children.find(levels[level]);
+    if (exact != node.children.end()){
+        match(*exact->second, level + 1, system_topic);
+    }
+    if (wildcards){
+        auto one = node.children.find("+");
+        if (one != node.children.end()){
+            match(*one->second, level + 1, system_topic);
+        }
+    }
+}
+
+/**
+ * Splits topic name or filter into levels
+ * @param name Topic name or filter
+ */
+void Broker::split(const std::string& name)
+{
+    levels.clear();
+    size_t start = 0;
+    while (true){
+        size_t end = name.find('/', start);
+        levels.push_back(name.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos){
+            return;
+        }
+        start = end + 1;
+    }
+}
@@ -0,0 +1,121 @@
+/** @file Broker.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/** Counters of broker traffic */
+struct BrokerStats{
+    uint64_t connections = 0;        ///< Currently connected clients
+    uint64_t total_connections = 0;  ///< Accepted CONNECT packets since start
+    uint64_t received = 0;           ///< PUBLISH packets received from clients
+    uint64_t received_bytes = 0;     ///< Payload bytes of received messages
+    uint64_t sent = 0;               ///< PUBLISH packets queued for subscribers
+    uint64_t sent_bytes = 0;         ///< Payload bytes of sent messages
+    uint64_t received_wire_bytes = 0;  ///< All bytes read from clients including packet headers
+    uint64_t sent_wire_bytes = 0;      ///< All bytes written to clients including packet headers
+    uint64_t dropped = 0;            ///< Messages not sent because output of subscriber was full
+    uint64_t subscriptions = 0;      ///< Current subscriptions of all clients
+    uint64_t retained = 0;           ///< Current retained messages
+};
+
+/**
+ * Minimal MQTT 3.1.1 and 5 broker for local benchmarks, runs a single event loop thread on POSIX sockets.
+ * Supports CONNECT, SUBSCRIBE and UNSUBSCRIBE with + and # wildcards, PUBLISH with QoS 0 and 1, retained
+ * messages, and from MQTT 5 topic aliases, subscription identifiers and forwarding of message properties.
+ * Sessions are never kept, will messages are not published, QoS 1 messages are not retransmitted and
+ * subscriptions with QoS 2 are granted QoS 1. Messages to a subscriber whose output queue exceeds
+ * max_queued are dropped instead of slowing the publisher.
+ */
+class Broker{
+public:
+    /** Output bytes waiting for one client above which messages to it are dropped */
+    size_t max_queued = 64 * 1024 * 1024;
+    /** Topic aliases accepted from every MQTT 5 client */
+    uint16_t topic_alias_maximum = 1024;
+
+    Broker();
+    Broker(const Broker&) = delete;
+    Broker& operator=(const Broker&) = delete;
+    ~Broker();
+
+    void start(const std::string& address, uint16_t port);
+    void stop();
+    uint16_t port() const;
+    BrokerStats stats() const;
+
+private:
+    struct Client;
+    struct Node;
+    /** Subscription of one client stored in the filter tree */
+    struct Subscription{
+        Client* client;
+        int qos;
+        bool no_local;
+        uint32_t id;  ///< Subscription identifier, 0 if none
+    };
+    struct Retained{
+        std::string payload;
+        int qos;
+        std::string properties;
+    };
+
+    std::thread loop;
+    std::atomic<bool> running{false};
+    int listen_fd = -1;
+    int wake_pipe[2] = {-1, -1};
+    uint16_t bound_port = 0;
+
+    // Used only by the event loop thread
+    std::vector<std::unique_ptr<Client>> clients;
+    std::unordered_map<std::string, Client*> clients_by_id;
+    std::vector<Client*> pending;
+    std::unique_ptr<Node> root;
+    std::unordered_map<std::string, Retained> retained_messages;
+    uint64_t assigned_ids = 0;
+    std::vector<std::string> levels;
+    std::vector<Subscription> matches;
+    std::vector<uint32_t> ids;
+    std::string header;
+
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> total_connections{0};
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> received_bytes{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> sent_bytes{0};
+    std::atomic<uint64_t> received_wire_bytes{0};
+    std::atomic<uint64_t> sent_wire_bytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> subscription_count{0};
+    std::atomic<uint64_t> retained_count{0};
+
+    void run();
+    void accept_clients();
+    bool read_client(Client& client);
+    void flush(Client& client);
+    void close_client(Client& client);
+    void queue(Client& client, uint8_t type, const std::string& body);
+    bool handle(Client& client, uint8_t fixed, const uint8_t* body, size_t length);
+    bool on_connect(Client& client, const uint8_t* body, size_t length);
+    bool on_publish(Client& client, uint8_t flags, const uint8_t* body, size_t length);
+    bool on_subscribe(Client& client, const uint8_t* body, size_t length);
+    bool on_unsubscribe(Client& client, const uint8_t* body, size_t length);
+    void deliver(const Client& sender, const std::string& topic, const char* payload, size_t size,
+                 int qos, const std::string& properties);
+    void send_publish(Client& client, const std::string& topic, const char* payload, size_t size, int qos,
+                      bool retain, const std::string& properties, const std::vector<uint32_t>& subscription_ids);
+    void subscribe(const std::string& filter, const Subscription& subscription);
+    void unsubscribe(const std::string& filter, const Client* client);
+    void match(const Node& node, size_t level, bool system_topic);
+    void split(const std::string& name);
+};
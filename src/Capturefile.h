@@ -0,0 +1,164 @@
+/** @file Capturefile.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Binary capture file shared by explorer recording and simulator replay.
+ *  File starts with 8 byte magic "MQTTCAP1" followed by records:
+ *  time (8 B, ns since epoch) | topic length (2 B) | payload length (4 B) | flags (1 B, bits 0-1 QoS, bit 2 retain)
+ *  | topic | payload, all integers little endian.
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Magic bytes at the start of capture file */
+const char CAPTURE_MAGIC[] = "MQTTCAP1";
+/** Size of magic */
+const size_t CAPTURE_MAGIC_SIZE = 8;
+/** Size of fixed record header */
+const size_t CAPTURE_RECORD_HEADER = 15;
+
+/** One captured message, topic and payload point into the capture buffer */
+struct CaptureRecord{
+    int64_t time_ns = 0;
+    int qos = 0;
+    bool retained = false;
+    const char* topic = nullptr;
+    size_t topic_len = 0;
+    const char* payload = nullptr;
+    size_t payload_len = 0;
+};
+
+/**
+ * Appends encoded record to buffer
+ * @param out Output buffer
+ * @param time_ns Receive time in ns since epoch
+ * @param topic Topic of message
+ * @param payload Payload of message
+ * @param qos Quality of service
+ * @param retained Retain flag
+ */
+inline void append_capture_record(std::string& out, int64_t time_ns, const std::string& topic, const std::string& payload,
+                                  int qos, bool retained)
+{
+    unsigned char header[CAPTURE_RECORD_HEADER];
+    uint64_t time = static_cast<uint64_t>(time_ns);
+    for (int i = 0; i < 8; i++){
+        header[i] = static_cast<unsigned char>(time >> (8 * i));
+    }
+    header[8] = static_cast<unsigned char>(topic.size());
+    header[9] = static_cast<unsigned char>(topic.size() >> 8);
+    for (int i = 0; i < 4; i++){
+        header[10 + i] = static_cast<unsigned char>(payload.size() >> (8 * i));
+    }
+    header[14] = static_cast<unsigned char>((qos & 3) | (retained ? 4 : 0));
+    out.append(reinterpret_cast<const char*>(header), CAPTURE_RECORD_HEADER);
+    out.append(topic);
+    out.append(payload);
+}
+
+/**
+ * Memory mapped reader of capture file
+ */
+class CaptureReader{
+public:
+    CaptureReader() = default;
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+    ~CaptureReader()
+    {
+        close();
+    }
+
+    /**
+     * Maps capture file into memory
+     * @param path Path to capture file
+     * @return True if file is a valid capture
+     */
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0){
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= CAPTURE_MAGIC_SIZE){
+            void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED){
+                data = static_cast<const char*>(map);
+                size = st.st_size;
+                madvise(map, size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (data == nullptr || memcmp(data, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0){
+            close();
+            return false;
+        }
+        pos = CAPTURE_MAGIC_SIZE;
+        return true;
+    }
+
+    /** Unmaps capture file */
+    void close()
+    {
+        if (data != nullptr){
+            munmap(const_cast<char*>(data), size);
+        }
+        data = nullptr;
+        size = 0;
+        pos = 0;
+    }
+
+    /** Restarts reading from first record */
+    void rewind()
+    {
+        pos = CAPTURE_MAGIC_SIZE;
+    }
+
+    /**
+     * Decodes next record
+     * @param record Output record, valid while the file is open
+     * @return False at end of file or on truncated record
+     */
+    bool next(CaptureRecord& record)
+    {
+        if (data == nullptr || size - pos < CAPTURE_RECORD_HEADER){
+            return false;
+        }
+        auto header = reinterpret_cast<const unsigned char*>(data + pos);
+        uint64_t time = 0;
+        for (int i = 0; i < 8; i++){
+            time |= static_cast<uint64_t>(header[i]) << (8 * i);
+        }
+        size_t topic_len = header[8] | (header[9] << 8);
+        size_t payload_len = 0;
+        for (int i = 0; i < 4; i++){
+            payload_len |= static_cast<size_t>(header[10 + i]) << (8 * i);
+        }
+        if (size - pos - CAPTURE_RECORD_HEADER < topic_len + payload_len){
+            return false;
+        }
+        record.time_ns = static_cast<int64_t>(time);
+        record.qos = header[14] & 3;
+        record.retained = (header[14] & 4) != 0;
+        record.topic = data + pos + CAPTURE_RECORD_HEADER;
+        record.topic_len = topic_len;
+        record.payload = record.topic + topic_len;
+        record.payload_len = payload_len;
+        pos += CAPTURE_RECORD_HEADER + topic_len + payload_len;
+        return true;
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+};
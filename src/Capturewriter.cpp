@@ -0,0 +1,113 @@
+/** @file Capturewriter.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Capturewriter.h"
+#include "Capturefile.h"
+#include <chrono>
+
+/** Destructor finishes recording */
+CaptureWriter::~CaptureWriter()
+{
+    stop();
+}
+
+/**
+ * Creates capture file and starts writer thread
+ * @param path Path to capture file
+ * @return True if file was created
+ */
+bool CaptureWriter::start(const std::string& path)
+{
+    stop();
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr){
+        return false;
+    }
+    fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, file);
+    records = 0;
+    drops = 0;
+    buffer.reserve(FLUSH_SIZE * 2);
+    running = true;
+    writer = std::thread(&CaptureWriter::run, this);
+    return true;
+}
+
+/** Writes remaining records and closes capture file */
+void CaptureWriter::stop()
+{
+    if (!running.exchange(false)){
+        return;
+    }
+    wakeup.notify_one();
+    writer.join();
+    fclose(file);
+    file = nullptr;
+}
+
+/** @return True while recording */
+bool CaptureWriter::active() const
+{
+    return running.load(std::memory_order_relaxed);
+}
+
+/**
+ * Appends message to capture, called from client thread
+ * @param time_ns Receive time in ns since epoch
+ * @param topic Topic of message
+ * @param payload Payload of message
+ * @param qos Quality of service
+ * @param retained Retain flag
+ */
+void CaptureWriter::record(int64_t time_ns, const std::string& topic, const std::string& payload, int qos, bool retained)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running.load(std::memory_order_relaxed)){
+        return;
+    }
+    if (buffer.size() + CAPTURE_RECORD_HEADER + topic.size() + payload.size() > MAX_BUFFER){
+        drops++;
+        return;
+    }
+    append_capture_record(buffer, time_ns, topic, payload, qos, retained);
+    records++;
+    if (buffer.size() >= FLUSH_SIZE){
+        lock.unlock();
+        wakeup.notify_one();
+    }
+}
+
+/** @return Number of recorded messages */
+uint64_t CaptureWriter::recorded() const
+{
+    return records.load();
+}
+
+/** @return Number of messages dropped because disk did not keep up */
+uint64_t CaptureWriter::dropped() const
+{
+    return drops.load();
+}
+
+/** Body of writer thread, swaps buffers and writes the full one without holding the lock */
+void CaptureWriter::run()
+{
+    std::string back;
+    back.reserve(FLUSH_SIZE * 2);
+    bool more = true;
+    while (more){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait_for(lock, std::chrono::milliseconds(200),
+                            [this]{ return buffer.size() >= FLUSH_SIZE || !running.load(); });
+            more = running.load();
+            buffer.swap(back);
+        }
+        if (!back.empty()){
+            fwrite(back.data(), 1, back.size(), file);
+            back.clear();
+        }
+    }
+    fflush(file);
+}
@@ -0,0 +1,44 @@
+/** @file Capturewriter.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Writes received messages into capture file (see Capturefile.h), records are appended into memory buffer
+ * which background thread swaps with second buffer and writes to disk
+ */
+class CaptureWriter{
+public:
+    ~CaptureWriter();
+    bool start(const std::string& path);
+    void stop();
+    bool active() const;
+    void record(int64_t time_ns, const std::string& topic, const std::string& payload, int qos, bool retained);
+    uint64_t recorded() const;
+    uint64_t dropped() const;
+
+private:
+    /** Buffer size which wakes up writer thread */
+    static const size_t FLUSH_SIZE = 1 << 20;
+    /** Maximum buffer size, records are dropped when disk does not keep up */
+    static const size_t MAX_BUFFER = 64 << 20;
+
+    FILE* file = nullptr;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::string buffer;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> drops{0};
+
+    void run();
+};
@@ -0,0 +1,105 @@
+/** @file Latency.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Latency.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+/**
+ * Records one received message
+ * @param topic Topic of message
+ * @param sequence Sequence number from latency header
+ * @param latency Time between sending and receiving the message
+ */
+void LatencyTracker::record(const std::string& topic, uint64_t sequence, std::chrono::nanoseconds latency)
+{
+    int64_t us = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (int64_t(1) << (bucket + 1)) <= us){
+        bucket++;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    TopicStats& stats = topics[topic];
+    if (stats.received == 0){
+        stats.min_us = us;
+        stats.max_us = us;
+        stats.next_sequence = sequence + 1;
+    } else if (sequence >= stats.next_sequence){
+        stats.lost += sequence - stats.next_sequence;
+        stats.next_sequence = sequence + 1;
+    } else {
+        // Message counted as lost earlier arrived late
+        stats.reordered++;
+        if (stats.lost > 0){
+            stats.lost--;
+        }
+    }
+    stats.received++;
+    stats.min_us = std::min(stats.min_us, us);
+    stats.max_us = std::max(stats.max_us, us);
+    stats.sum_us += us;
+    stats.histogram[bucket]++;
+}
+
+/** Discards all collected statistics */
+void LatencyTracker::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    topics.clear();
+}
+
+/** @return True if no message with latency header was recorded */
+bool LatencyTracker::empty() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return topics.empty();
+}
+
+/**
+ * Estimates latency percentile from histogram
+ * @param stats Topic statistics
+ * @param fraction Requested percentile (0.5 = median)
+ * @return Upper bound of bucket containing the percentile in microseconds
+ */
+int64_t LatencyTracker::percentile(const TopicStats& stats, double fraction)
+{
+    uint64_t target = static_cast<uint64_t>(fraction * stats.received);
+    uint64_t sum = 0;
+    for (int i = 0; i < BUCKETS; i++){
+        sum += stats.histogram[i];
+        if (sum > target){
+            return std::min(stats.max_us, int64_t(1) << (i + 1));
+        }
+    }
+    return stats.max_us;
+}
+
+/**
+ * Formats statistics of all topics as text
+ * @return Human readable report
+ */
+std::string LatencyTracker::report() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::stringstream s;
+    for (const auto& it: topics){
+        const TopicStats& stats = it.second;
+        s << it.first << "\n"
+          << "\treceived: " << stats.received << "  lost: " << stats.lost << "  reordered: " << stats.reordered << "\n"
+          << "\tlatency us  min: " << stats.min_us << "  avg: " << stats.sum_us / int64_t(stats.received)
+          << "  p50: " << percentile(stats, 0.5) << "  p99: " << percentile(stats, 0.99)
+          << "  max: " << stats.max_us << "\n";
+        for (int i = 0; i < BUCKETS; i++){
+            if (stats.histogram[i] == 0){
+                continue;
+            }
+            s << "\t" << std::setw(10) << (i == 0 ? 0 : int64_t(1) << i) << " - "
+              << std::setw(10) << (int64_t(1) << (i + 1)) << " us: " << stats.histogram[i] << "\n";
+        }
+    }
+    return s.str();
+}
@@ -0,0 +1,99 @@
+/** @file Latency.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  End-to-end latency measurement shared by the traffic simulator and the explorer.
+ *  In latency mode the simulator prefixes every payload with a small text header
+ *  "@lat:<sequence>:<send time in ns since epoch>;" which the receiver strips and records.
+ */
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/** Prefix identifying payloads carrying a latency header */
+const std::string LATENCY_HEADER_PREFIX = "@lat:";
+
+/** Decoded latency header */
+struct LatencyHeader{
+    uint64_t sequence = 0;
+    std::chrono::time_point<std::chrono::system_clock> sent_time;
+    size_t length = 0;  ///< Number of payload bytes occupied by the header
+};
+
+/**
+ * Creates latency header for a message
+ * @param sequence Per topic sequence number
+ * @param sent_time Time of message creation
+ * @return Header to be prepended to payload
+ */
+inline std::string make_latency_header(uint64_t sequence, std::chrono::time_point<std::chrono::system_clock> sent_time)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(sent_time.time_since_epoch()).count();
+    return LATENCY_HEADER_PREFIX + std::to_string(sequence) + ':' + std::to_string(ns) + ';';
+}
+
+/**
+ * Parses latency header at the start of payload
+ * @param payload Message payload
+ * @param header Output decoded header
+ * @return True if payload starts with a complete header, numeric fields and both terminators
+ */
+inline bool parse_latency_header(const std::string& payload, LatencyHeader& header)
+{
+    if (payload.compare(0, LATENCY_HEADER_PREFIX.size(), LATENCY_HEADER_PREFIX) != 0){
+        return false;
+    }
+    size_t pos = LATENCY_HEADER_PREFIX.size();
+    uint64_t fields[2] = {0, 0};
+    for (int i = 0; i < 2; i++){
+        size_t start = pos;
+        while (pos < payload.size() && payload[pos] >= '0' && payload[pos] <= '9'){
+            fields[i] = fields[i] * 10 + (payload[pos] - '0');
+            pos++;
+        }
+        if (pos == start || pos >= payload.size() || payload[pos] != (i == 0 ? ':' : ';')){
+            return false;
+        }
+        pos++;
+    }
+    header.sequence = fields[0];
+    header.sent_time = std::chrono::time_point<std::chrono::system_clock>(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(fields[1])));
+    header.length = pos;
+    return true;
+}
+
+/**
+ * Collects latency histograms, loss and reordering statistics per topic
+ */
+class LatencyTracker{
+public:
+    /** Number of histogram buckets, bucket i holds latencies in [2^i, 2^(i+1)) microseconds */
+    static const int BUCKETS = 32;
+
+    struct TopicStats{
+        uint64_t received = 0;
+        uint64_t lost = 0;
+        uint64_t reordered = 0;
+        uint64_t next_sequence = 0;
+        int64_t min_us = 0;
+        int64_t max_us = 0;
+        int64_t sum_us = 0;
+        uint64_t histogram[BUCKETS] = {};
+    };
+
+    void record(const std::string& topic, uint64_t sequence, std::chrono::nanoseconds latency);
+    void reset();
+    bool empty() const;
+    std::string report() const;
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, TopicStats> topics;
+
+    static int64_t percentile(const TopicStats& stats, double fraction);
+};
@@ -4,54 +4,49 @@
  */
 
 #include "Mqttclient.h"
+#include "jsonpayload.h"
+#include <QCoreApplication>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QtGlobal>
 #include <utility>
 #include <sstream>
-#include <stdexcept>
 
-/** Connection options */
-Mqttclient::Mqttclient() = default;
-/** Quality of service */
-const int QOS = 1;
-/** Root topic name */
-const std::string TOPIC = "#";
-
-/** Client callback override for when action fails */
-void Mqttclient::on_failure(const mqtt::token& asyncActionToken) {}
-
-/** Client callback override for when action succeeds */
-void Mqttclient::on_success(const mqtt::token& asyncActionToken) {}
-
-/**
- * Callback for when client connects to a server
- * @param what Connection status message
- */
-void Mqttclient::connected(const std::string& what)
+/** Constructor, search index takes payloads of compressed messages from topic history */
+Mqttclient::Mqttclient()
 {
-    client->subscribe(TOPIC, QOS);
-    std::cout << "Connected\n";
+    search.set_resolver([this](const std::string& topic, std::chrono::time_point<std::chrono::system_clock> received_time){
+        return history_payload(topic, received_time);
+    });
 }
 
 /**
- * Callback for when client loses connection to a server
- * @param cause Cause of connection loss
+ * Looks up payload of message in topic history, called by search index in GUI thread
+ * @param topic Full topic name
+ * @param received_time Time of arrival of the message
+ * @return Payload, empty if the message is not in history
  */
-void Mqttclient::connection_lost(const std::string& cause)
+mqtt::binary_ref Mqttclient::history_payload(const std::string& topic,
+                                             std::chrono::time_point<std::chrono::system_clock> received_time) const
 {
-    std::cerr << "Connection lost\n";
-    if (!cause.empty()){
-        std::cout << "\tcause: " << cause << "\n";
+    QStandardItem* topicItem = itemModel ? findTopicItem(itemModel.get(), topic) : nullptr;
+    if (topicItem == nullptr || topicItem->data().isNull()){
+        return mqtt::binary_ref();
     }
+    const TopicMessage* message = topicItem->data().value<Topicdata*>()->find_message(received_time);
+    return message ? message->get_payload_ref() : mqtt::binary_ref();
 }
 
 /**
- * Callback for when a message arrives
+ * Inserts received message into topic tree
  * @param msg Pointer to received message
+ * @param received_time Time of arrival
  */
-void Mqttclient::message_arrived(mqtt::const_message_ptr msg)
+void Mqttclient::process_message(mqtt::const_message_ptr msg,
+                                 std::chrono::time_point<std::chrono::system_clock> received_time)
 {
     QStandardItem* topicItem = getTopicItem(itemModel.get(), msg->get_topic());
-    create_or_update_topic(*topicItem, msg);
+    create_or_update_topic(*topicItem, msg, received_time, collapse_repeated);
 }
 
 /**
@@ -87,12 +82,39 @@ QStandardItem* Mqttclient::getTopicItem(QStandardItemModel *model, const std::st
     return item;
 }
 
+/**
+ * Finds item of topic without creating it
+ * @param model Model representing current topic tree
+ * @param topic_name Topic name
+ * @return modelItem for topic, nullptr if the topic is not in the tree
+ */
+QStandardItem* Mqttclient::findTopicItem(QStandardItemModel *model, const std::string &topic_name)
+{
+    std::stringstream s(topic_name);
+    std::string token;
+    QStandardItem *item = model->invisibleRootItem();
+    while (item != nullptr && std::getline(s, token, '/')) {
+        QStandardItem *child = nullptr;
+        for (int i = 0; i < item->rowCount() && child == nullptr; i++){
+            if (item->child(i)->text().toStdString() == token){
+                child = item->child(i);
+            }
+        }
+        item = child;
+    }
+    return item;
+}
+
 /**
  * Updates topic with new data from message
  * @param topicItem modelItem of topic
  * @param msg Message containing new data
+ * @param received_time Time of arrival
+ * @param collapse_repeated Count message repeating the latest one instead of adding it to history
  */
-void Mqttclient::create_or_update_topic(QStandardItem& topicItem, mqtt::const_message_ptr& msg)
+void Mqttclient::create_or_update_topic(QStandardItem& topicItem, mqtt::const_message_ptr& msg,
+                                        std::chrono::time_point<std::chrono::system_clock> received_time,
+                                        bool collapse_repeated)
 {
     Topicdata* topicData;
     if (topicItem.data().isNull()){
@@ -104,105 +126,229 @@ void Mqttclient::create_or_update_topic(QStandardItem& topicItem, mqtt::const_me
         topicData = topicItem.data().value<Topicdata*>();
     }
     TopicMessage* message = new TopicMessage();
-    message->received_time = std::chrono::system_clock::now();
-    message->payload = msg->get_payload();
+    message->received_time = received_time;
+    message->last_received_time = received_time;
+    message->payload = msg->get_payload_ref();
     auto * image = new QPixmap();
     uint len = message->payload.length()*sizeof(uchar);
-    const uchar *buf = (uchar*)message->payload.data();
+    const uchar *buf = message->payload.empty() ? nullptr : (uchar*)message->payload.data();
     if (image->loadFromData(buf, len, nullptr, Qt::AutoColor)){
         message->mime_type = "image/png";
     } else {
         message->mime_type = "text/plain";
     }
-    topicData->add_message(message);
+    topicData->add_message(message, collapse_repeated);
 }
 
 /**
- * Connects to a specified MQTT server
+ * Stops ingestion worker while the topic tree still exists
+ */
+Mqttclient::~Mqttclient()
+{
+    stop_worker();
+}
+
+/**
+ * Connects to a specified MQTT server with new empty topic tree
  * @param server_address Server address
  * @param server_port Server port
  * @return Returns true at success
  */
 bool Mqttclient::connect(const std::string& server_address, std::string server_port, const std::string& username, const std::string& password)
 {
-    std::string client_id = "icp-mqtt-explorer-vut-fit";
-    if (server_port.empty()){
-        server_port = "1883";
-    }
-    client = std::make_unique<mqtt::async_client>(server_address+":"+server_port, client_id);
-    if (username.empty()){
-        connOpts = mqtt::connect_options_builder()
-            .clean_session(true)
-            .finalize();
-    } else {
-        connOpts = mqtt::connect_options_builder()
-                .clean_session(true)
-                .user_name(username)
-                .password(password)
-                .finalize();
-    }
-    client->set_callback(*this);
+    stop_worker();
     itemModel = std::make_unique<QStandardItemModel>();
-
-    try {
-        std::cout << "Connecting to the MQTT server...\n" << std::flush;
-        client->connect(connOpts, nullptr, *this)->wait();
-    }
-    catch (const mqtt::exception& exc) {
-        std::cerr << "\nERROR: Unable to connect to MQTT server: '"
-                  << server_address << "'" << exc << std::endl;
-        throw;
-    }
-    return true;
+    return Mqttcore::connect(server_address, std::move(server_port), username, password);
 }
 
 /**
- * Creates message object and sends it
- * @param topic Topic of message
- * @param value Value of message
+ * Compresses payloads of history messages in thread pool. Compressed block is attached to the messages
+ * in GUI thread, where payloads are read, and only if it saves at least a fifth of memory.
  */
-void Mqttclient::send_message(const std::string& topic,const std::string& value)
-{
-    if(topic.empty()){
-        throw std::invalid_argument("Message topic is empty");
-    }
-    auto msg = mqtt::make_message(topic, value);
-    client->publish(msg);
-}
+class HistoryCompressor : public QRunnable{
+    std::vector<TopicMessage*> block_messages;
+public:
+    /** Smallest block worth compressing */
+    static const int MIN_BYTES = 4096;
 
-/**
- * Stops consuming messages, removing internal callback and discarding any unread messages
- */
-void Mqttclient::stop()
-{
-    if (client){
-        client->stop_consuming();
+    explicit HistoryCompressor(std::vector<TopicMessage*> block_messages) :
+        block_messages(std::move(block_messages)) {}
+
+    /** Compresses the block, messages are never deleted so they may be accessed from the pool */
+    void run() override
+    {
+        auto block = std::make_shared<HistoryBlock>();
+        QByteArray raw;
+        for (const TopicMessage* message: block_messages){
+            block->offsets.push_back(static_cast<uint32_t>(raw.size()));
+            if (!message->payload.empty()){
+                raw.append(message->payload.data(), int(message->payload.size()));
+            }
+        }
+        block->offsets.push_back(static_cast<uint32_t>(raw.size()));
+        if (raw.size() < MIN_BYTES){
+            return;
+        }
+        block->compressed = qCompress(raw);
+        if (block->compressed.size() > raw.size() * 4 / 5){
+            return;
+        }
+        auto messages = std::move(block_messages);
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [messages, block](){
+            for (size_t i = 0; i < messages.size(); i++){
+                messages[i]->compress_into(block, static_cast<uint32_t>(i));
+            }
+        }, Qt::QueuedConnection);
     }
-}
+};
 
 /**
- * Adds message to topic history
- * @param message Pointer to message object
+ * Creates text of history entry
+ * @param message Message of the entry
+ * @return Receive time and start of payload, with repeat count of collapsed entry
  */
-void Topicdata::add_message(TopicMessage* message)
+QString Topicdata::history_text(const TopicMessage* message)
 {
-    auto *messageItem = new QStandardItem();
     time_t time = std::chrono::system_clock::to_time_t(message->received_time);
     char * timestamptext = ctime(&time);
+    QString text;
     if (message->mime_type == "image/png"){
-        messageItem->setText(QString(timestamptext) + QString("Image data"));
+        text = QString(timestamptext) + QString("Image data");
     } else {
-        auto messagePart = message->payload.substr(0, 50);
+        std::string messagePart = message->payload.empty() ? std::string() : message->payload.str().substr(0, 50);
         if (messagePart.size() == 50){
             messagePart.append("...");
         }
-        messageItem->setText((timestamptext + messagePart).data());
+        text = (timestamptext + messagePart).data();
     }
+    if (message->repeats > 1){
+        text += QString("  (%1x)").arg(message->repeats);
+    }
+    return text;
+}
+
+/**
+ * Adds message to topic history
+ * @param message Pointer to message object, deleted when it is collapsed into latest message
+ * @param collapse_repeated Count message with the same payload as latest message instead of adding it
+ */
+void Topicdata::add_message(TopicMessage* message, bool collapse_repeated)
+{
+    // Payloads are interned, identical payloads usually share the data
+    if (collapse_repeated && latest != nullptr && latest->mime_type == message->mime_type
+        && latest->payload.size() == message->payload.size()
+        && (latest->payload.empty() || latest->payload.data() == message->payload.data()
+            || latest->payload.str() == message->payload.str())){
+        latest->repeats++;
+        latest->last_received_time = message->received_time;
+        messages.item(messages.rowCount() - 1)->setText(history_text(latest));
+        delete message;
+        emit data_changed();
+        return;
+    }
+    auto *messageItem = new QStandardItem(history_text(message));
     QVariant variant;
     auto* topicMessage = message;
     variant.setValue(topicMessage);
     messageItem->setData(variant);
     messages.appendRow(messageItem);
     latest = topicMessage;
+    if (message->mime_type == "text/plain"){
+        uncompressed.push_back(message);
+        if (uncompressed.size() >= HOT_MESSAGES + BLOCK_MESSAGES){
+            std::vector<TopicMessage*> block(uncompressed.begin(), uncompressed.begin() + BLOCK_MESSAGES);
+            uncompressed.erase(uncompressed.begin(), uncompressed.begin() + BLOCK_MESSAGES);
+            QThreadPool::globalInstance()->start(new HistoryCompressor(std::move(block)));
+        }
+    }
     emit data_changed();
 }
+
+/**
+ * Finds history entry of message, a collapsed entry stands for all its repeats
+ * @param received_time Time of arrival of the message
+ * @return Entry or nullptr if no entry covers the time
+ */
+const TopicMessage* Topicdata::find_message(std::chrono::time_point<std::chrono::system_clock> received_time) const
+{
+    // Entries are appended in order of arrival
+    int low = 0, high = messages.rowCount();
+    while (low < high){
+        int middle = (low + high) / 2;
+        if (messages.item(middle)->data().value<TopicMessage*>()->received_time <= received_time){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0){
+        return nullptr;
+    }
+    const TopicMessage* message = messages.item(low - 1)->data().value<TopicMessage*>();
+    return received_time <= message->last_received_time ? message : nullptr;
+}
+
+/**
+ * Parses payload as JSON on first call, later calls return the cached document. Document of a payload
+ * that is not compressed is shared with dashboard tiles showing the same payload.
+ * @return Parsed payload, nullptr if payload is not a JSON object or array
+ */
+const QJsonDocument* TopicMessage::json() const
+{
+    if (!json_parsed && mime_type != "image/png"){
+        if (!block){
+            parsed_json = sharedJsonPayload(payload);
+        } else {
+            auto document = std::make_shared<QJsonDocument>();
+            mqtt::binary text = get_payload();
+            if (parseJsonPayload(text.data(), text.size(), *document)){
+                parsed_json = std::move(document);
+            }
+        }
+    }
+    json_parsed = true;
+    return parsed_json.get();
+}
+
+/**
+ * @return Payload of message, decompressed from history block if the message was compressed
+ */
+mqtt::binary TopicMessage::get_payload() const
+{
+    if (!block){
+        return payload.empty() ? mqtt::binary() : payload.str();
+    }
+    QByteArray raw = qUncompress(block->compressed);
+    uint32_t start = block->offsets[block_index];
+    uint32_t end = block->offsets[block_index + 1];
+    if (raw.size() < static_cast<int>(end)){
+        return mqtt::binary();
+    }
+    return mqtt::binary(raw.constData() + start, end - start);
+}
+
+/**
+ * @return Shared payload of recent message, decompressed copy if the message was compressed
+ */
+mqtt::binary_ref TopicMessage::get_payload_ref() const
+{
+    if (!block){
+        return payload;
+    }
+    return mqtt::binary_ref(get_payload());
+}
+
+/**
+ * Replaces payload by its copy in compressed history block, called in GUI thread. The search index holds
+ * only weak references, so the payload is freed unless another message shares it.
+ * @param compressed_block Block containing the payload
+ * @param index Index of the payload in block
+ */
+void TopicMessage::compress_into(std::shared_ptr<const HistoryBlock> compressed_block, uint32_t index)
+{
+    block = std::move(compressed_block);
+    block_index = index;
+    payload = mqtt::binary_ref();
+    parsed_json.reset();
+    json_parsed = false;
+}
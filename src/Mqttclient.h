@@ -4,24 +4,66 @@
  */
 
 #pragma once
-#include "mqtt/async_client.h"
+#include "Mqttcore.h"
 #include "QStandardItemModel"
+#include <QJsonDocument>
+#include <memory>
+#include <vector>
+
+/** Payloads of consecutive history messages of one topic compressed together */
+struct HistoryBlock{
+    QByteArray compressed;
+    std::vector<uint32_t> offsets;  ///< Start of every payload in uncompressed block, last item is total size
+};
 
 class TopicMessage{
 public:
     std::chrono::time_point<std::chrono::system_clock> received_time;
+    /** Time of last repeat of collapsed message */
+    std::chrono::time_point<std::chrono::system_clock> last_received_time;
+    /** Number of consecutive identical messages this entry stands for */
+    uint32_t repeats = 1;
     std::string mime_type;
-    mqtt::binary payload;
+    /** Payload of recent message shared through payload store, empty after compression into a history block */
+    mqtt::binary_ref payload;
+
+    mqtt::binary get_payload() const;
+    mqtt::binary_ref get_payload_ref() const;
+    const QJsonDocument* json() const;
+    void compress_into(std::shared_ptr<const HistoryBlock> compressed_block, uint32_t index);
+
+private:
+    /** Parsed payload, valid after first call of json, shared with dashboard tiles while not compressed */
+    mutable std::shared_ptr<const QJsonDocument> parsed_json;
+    mutable bool json_parsed = false;
+    std::shared_ptr<const HistoryBlock> block;
+    uint32_t block_index = 0;
 };
 
 Q_DECLARE_METATYPE(TopicMessage*)
 
+/**
+ * History of one topic. Payloads of older text messages are compressed in blocks on a background thread,
+ * newest HOT_MESSAGES messages stay uncompressed.
+ */
 class Topicdata: public QObject{
     Q_OBJECT
 public:
+    /** Number of newest messages kept uncompressed */
+    static const size_t HOT_MESSAGES = 64;
+    /** Number of messages compressed together */
+    static const size_t BLOCK_MESSAGES = 256;
+
     QStandardItemModel messages;
-    void add_message(TopicMessage* message);
-    TopicMessage* latest;
+    void add_message(TopicMessage* message, bool collapse_repeated = false);
+    const TopicMessage* find_message(std::chrono::time_point<std::chrono::system_clock> received_time) const;
+    TopicMessage* latest = nullptr;
+
+private:
+    static QString history_text(const TopicMessage* message);
+
+    /** Text messages not yet given to compression, oldest first */
+    std::vector<TopicMessage*> uncompressed;
 
     signals:
         void data_changed();
@@ -29,26 +71,28 @@ public:
 
 Q_DECLARE_METATYPE(Topicdata*)
 
-class Mqttclient : public virtual mqtt::callback, public virtual mqtt::iaction_listener, public virtual QObject{
-    std::unique_ptr<mqtt::async_client> client;
-    mqtt::connect_options connOpts;
-
+class Mqttclient : public Mqttcore, public virtual QObject{
 public:
     std::unique_ptr<QStandardItemModel> itemModel;
+    /** Consecutive identical messages of a topic make one history entry with repeat count */
+    bool collapse_repeated = false;
     explicit Mqttclient();
+    ~Mqttclient() override;
     bool connect(const std::string& server_address, std::string server_port,
                  const std::string& username, const std::string& password);
-    void stop();
-    void send_message(const std::string& topic,const std::string& value);
-
-    // Callback functions
-    void message_arrived(mqtt::const_message_ptr msg) override;
-    void on_success(const mqtt::token &asyncActionToken) override;
-    void on_failure(const mqtt::token &asyncActionToken) override;
-    void connection_lost(const std::string& cause) override;
-    void connected(const std::string &what) override;
 
     // Model functions
     static QStandardItem* getTopicItem(QStandardItemModel* model, const std::string& topic_name);
-    static void create_or_update_topic(QStandardItem& topicItem, mqtt::const_message_ptr& msg);
+    static QStandardItem* findTopicItem(QStandardItemModel* model, const std::string& topic_name);
+    static void create_or_update_topic(QStandardItem& topicItem, mqtt::const_message_ptr& msg,
+                                       std::chrono::time_point<std::chrono::system_clock> received_time,
+                                       bool collapse_repeated = false);
+
+protected:
+    void process_message(mqtt::const_message_ptr msg,
+                         std::chrono::time_point<std::chrono::system_clock> received_time) override;
+
+private:
+    mqtt::binary_ref history_payload(const std::string& topic,
+                                     std::chrono::time_point<std::chrono::system_clock> received_time) const;
 };
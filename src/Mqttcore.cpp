@@ -0,0 +1,858 @@
+/** @file Mqttcore.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Mqttcore.h"
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Quality of service */
+const int QOS = 1;
+/** Subscription identifier of all filters in subscriptions, only messages carrying it are ingested */
+const int INGEST_SUBSCRIPTION_ID = 1;
+/** Session expiry interval in seconds requested with MQTT 5 persistent session */
+const int SESSION_EXPIRY = 7 * 24 * 3600;
+
+const char Mqttcore::PERSISTENT_CLIENT_ID[] = "icp-mqtt-explorer-vut-fit";
+
+namespace {
+
+/**
+ * Creates client identifier unique to this process
+ * @return Identifier made of host name, process id and random suffix
+ */
+std::string unique_client_id()
+{
+    char host[32] = {};
+    gethostname(host, sizeof(host) - 1);
+    std::random_device random;
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "%04x", random() & 0xFFFF);
+    return std::string("icp-explorer-") + host + "-" + std::to_string(getpid()) + "-" + suffix;
+}
+
+}
+
+/** Stops the supervisor and ingestion worker before members they use are destroyed */
+Mqttcore::~Mqttcore()
+{
+    stop_file_publisher();
+    cancel_batch();
+    stop_supervisor();
+    stop_worker();
+    release_client();
+}
+
+/**
+ * Client callback override for when action fails, failed connection attempt is repeated later
+ * @param asyncActionToken Token of failed action
+ */
+void Mqttcore::on_failure(const mqtt::token& asyncActionToken)
+{
+    std::lock_guard<std::mutex> client_lock(client_mutex);
+    // Client of previous connection may still report its attempt
+    if (asyncActionToken.get_type() == mqtt::token::Type::CONNECT && asyncActionToken.get_client() == client.get()){
+        schedule_retry("Connection failed (code " + std::to_string(asyncActionToken.get_return_code()) + ")");
+    }
+}
+
+/**
+ * Client callback override for when action succeeds, subscriptions are restored after connecting
+ * unless the server kept the session
+ * @param asyncActionToken Token of finished action
+ */
+void Mqttcore::on_success(const mqtt::token& asyncActionToken)
+{
+    std::lock_guard<std::mutex> client_lock(client_mutex);
+    if (asyncActionToken.get_type() != mqtt::token::Type::CONNECT || asyncActionToken.get_client() != client.get()){
+        return;
+    }
+    auto response = asyncActionToken.get_connect_response();
+    bool session_present = response.is_session_present();
+    const auto& properties = response.get_properties();
+    routing = use_mqtt5 && !(properties.contains(mqtt::property::SUBSCRIPTION_IDENTIFIERS_AVAILABLE)
+                             && mqtt::get<int>(properties, mqtt::property::SUBSCRIPTION_IDENTIFIERS_AVAILABLE) == 0);
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (!supervising){
+            // Stopped while connecting
+            return;
+        }
+        state = ConnectionState::CONNECTED;
+        retry_delay = min_retry_delay;
+    }
+    if (!(persistent_session && session_present)){
+        for (const auto& filter: subscriptions){
+            if (routing){
+                client->subscribe(filter, QOS, mqtt::subscribe_options(),
+                                  mqtt::properties{mqtt::property(mqtt::property::SUBSCRIPTION_IDENTIFIER,
+                                                                  INGEST_SUBSCRIPTION_ID)});
+            } else {
+                client->subscribe(filter, QOS);
+            }
+        }
+    }
+    if (routing){
+        // Subscribed again even with resumed session, the filter may be watched since the last connection
+        std::vector<std::pair<std::string, int>> routed;
+        {
+            std::lock_guard<std::mutex> lock(routed_mutex);
+            for (const auto& it: routed_filters){
+                routed.emplace_back(it.first, it.second.subscription_id);
+            }
+        }
+        for (const auto& it: routed){
+            subscribe_routed(it.first, it.second);
+        }
+    }
+    notify_state(ConnectionState::CONNECTED, session_present ? "Connected, session resumed" : "Connected");
+}
+
+/**
+ * Callback for when client connects to a server, the state is reported from on_success
+ */
+void Mqttcore::connected(const std::string& /*what*/)
+{
+}
+
+/**
+ * Callback for when client loses connection to a server, reconnection is scheduled
+ * @param cause Cause of connection loss
+ */
+void Mqttcore::connection_lost(const std::string& cause)
+{
+    schedule_retry(cause.empty() ? "Connection lost" : "Connection lost: " + cause);
+}
+
+/**
+ * Plans next connection attempt, delay doubles after every failure up to max_retry_delay
+ * @param cause Reason of retry shown to user
+ */
+void Mqttcore::schedule_retry(const std::string& cause)
+{
+    std::chrono::milliseconds delay;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (!supervising){
+            return;
+        }
+        delay = retry_delay;
+        state = ConnectionState::WAITING;
+        retry_time = std::chrono::steady_clock::now() + delay;
+        retry_delay = std::min(max_retry_delay, retry_delay * 2);
+    }
+    state_cv.notify_all();
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), "%.1f", delay.count() / 1000.0);
+    notify_state(ConnectionState::WAITING, cause + ", retry in " + seconds + " s");
+}
+
+/**
+ * Body of supervisor thread, starts connection attempts when their time comes
+ */
+void Mqttcore::supervise()
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    while (supervising){
+        if (state != ConnectionState::WAITING){
+            state_cv.wait(lock, [this]{ return !supervising || state == ConnectionState::WAITING; });
+            continue;
+        }
+        if (state_cv.wait_until(lock, retry_time, [this]{ return !supervising || state != ConnectionState::WAITING; })){
+            continue;
+        }
+        state = ConnectionState::CONNECTING;
+        lock.unlock();
+        notify_state(ConnectionState::CONNECTING, "Connecting to " + client->get_server_uri());
+        try {
+            client->connect(connOpts, nullptr, *this);
+        } catch (const mqtt::exception& exc){
+            schedule_retry(std::string("Connection failed: ") + exc.what());
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * Ends supervisor thread, running connection attempt is abandoned
+ */
+void Mqttcore::stop_supervisor()
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        supervising = false;
+        state = ConnectionState::DISCONNECTED;
+    }
+    state_cv.notify_all();
+    if (supervisor.joinable()){
+        supervisor.join();
+    }
+}
+
+/**
+ * Disconnects and destroys client of previous connection, waits for the disconnect started by stop.
+ * Callbacks of the old client are disabled and its late action callbacks are ignored.
+ */
+void Mqttcore::release_client()
+{
+    std::unique_ptr<mqtt::async_client> old_client;
+    {
+        std::lock_guard<std::mutex> lock(client_mutex);
+        old_client = std::move(client);
+    }
+    if (old_client){
+        old_client->disable_callbacks();
+        try {
+            if (!disconnect_token && old_client->is_connected()){
+                disconnect_token = old_client->disconnect();
+            }
+            if (disconnect_token){
+                disconnect_token->wait_for(std::chrono::seconds(1));
+            }
+        } catch (const mqtt::exception&){
+        }
+    }
+    disconnect_token.reset();
+}
+
+/**
+ * Passes state change to on_state_changed
+ * @param new_state Current state
+ * @param detail Human readable detail
+ */
+void Mqttcore::notify_state(ConnectionState new_state, const std::string& detail)
+{
+    std::lock_guard<std::mutex> lock(handler_mutex);
+    if (on_state_changed){
+        on_state_changed(new_state, detail);
+    }
+}
+
+/**
+ * Sets handler called on every change of connection state from a background thread, after return
+ * the previous handler is not running. The handler must not call set_state_handler.
+ * @param handler New handler, nullptr removes it
+ */
+void Mqttcore::set_state_handler(StateHandler handler)
+{
+    std::lock_guard<std::mutex> lock(handler_mutex);
+    on_state_changed = std::move(handler);
+}
+
+/** @return Current state of connection */
+ConnectionState Mqttcore::connection_state() const
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return state;
+}
+
+/**
+ * Callback for when a message arrives
+ * @param msg Pointer to received message
+ */
+void Mqttcore::message_arrived(mqtt::const_message_ptr msg)
+{
+    if (consuming){
+        // Paho puts the message into consuming queue as well, worker processes it
+        arrived++;
+        return;
+    }
+    ingest(std::move(msg));
+}
+
+/**
+ * Interns payload, updates statistics, capture, topic store and search index with message and passes it to process_message.
+ * With routing, a server may send one copy of a message for every matching subscription; only the copy carrying
+ * the identifier of subscriptions is ingested, a copy sent only for watched filters just notifies their watchers.
+ * @param msg Pointer to received message
+ */
+void Mqttcore::ingest(mqtt::const_message_ptr msg)
+{
+    auto received_time = std::chrono::system_clock::now();
+    std::vector<int> subscription_ids;
+    bool routed = routing;
+    if (routed){
+        // Read before the message is replaced, new message has no properties
+        const auto& properties = msg->get_properties();
+        size_t count = properties.count(mqtt::property::SUBSCRIPTION_IDENTIFIER);
+        for (size_t i = 0; i < count; i++){
+            subscription_ids.push_back(mqtt::get<int>(properties, mqtt::property::SUBSCRIPTION_IDENTIFIER, i));
+        }
+    }
+    bool ingested = !routed || subscription_ids.empty()
+            || std::find(subscription_ids.begin(), subscription_ids.end(), INGEST_SUBSCRIPTION_ID) != subscription_ids.end();
+    LatencyHeader header;
+    // Without measurement payloads starting like a header are left intact
+    if (measure_latency && parse_latency_header(msg->get_payload(), header)){
+        if (ingested){
+            latency.record(msg->get_topic(), header.sequence, received_time - header.sent_time);
+        }
+        msg = mqtt::message::create(msg->get_topic(), msg->get_payload().substr(header.length),
+                                    msg->get_qos(), msg->is_retained());
+    }
+    if (!ingested){
+        topics.notify_routed(msg->get_topic(), msg->get_payload_ref(), subscription_ids);
+        return;
+    }
+    mqtt::binary_ref payload = payloads.intern(msg->get_payload_ref());
+    if (payload.ptr() != msg->get_payload_ref().ptr()){
+        // Duplicate payload, the message keeps the shared copy
+        msg = mqtt::message::create(msg->get_topic(), payload, msg->get_qos(), msg->is_retained());
+    }
+    if (capture.active()){
+        capture.record(std::chrono::duration_cast<std::chrono::nanoseconds>(received_time.time_since_epoch()).count(),
+                       msg->get_topic(), msg->get_payload(), msg->get_qos(), msg->is_retained());
+    }
+    topics.update(msg->get_topic(), msg->get_payload_ref(), received_time, routed ? &subscription_ids : nullptr);
+    search.add(msg->get_topic(), msg->get_payload_ref(), received_time);
+    process_message(msg, received_time);
+}
+
+/**
+ * Starts connecting to a specified MQTT server, returns without waiting for the connection
+ * @param server_address Server address
+ * @param server_port Server port
+ * @return Returns true at success
+ */
+bool Mqttcore::connect(const std::string& server_address, std::string server_port, const std::string& username, const std::string& password)
+{
+    std::string id = client_id;
+    if (id.empty()){
+        id = persistent_session ? PERSISTENT_CLIENT_ID : unique_client_id();
+    }
+    if (server_port.empty()){
+        server_port = "1883";
+    }
+    stop_file_publisher();
+    cancel_batch();
+    stop_supervisor();
+    stop_worker();
+    release_client();
+    routing = false;
+    auto builder = mqtt::connect_options_builder();
+    std::unique_ptr<mqtt::async_client> new_client;
+    if (use_mqtt5){
+        new_client = std::make_unique<mqtt::async_client>(server_address+":"+server_port, id,
+                                                      mqtt::create_options(MQTTVERSION_5));
+        builder.mqtt_version(MQTTVERSION_5).clean_start(!persistent_session);
+        if (persistent_session){
+            builder.properties({mqtt::property(mqtt::property::SESSION_EXPIRY_INTERVAL, SESSION_EXPIRY)});
+        }
+    } else {
+        new_client = std::make_unique<mqtt::async_client>(server_address+":"+server_port, id);
+        builder.clean_session(!persistent_session);
+    }
+    if (!username.empty()){
+        builder.user_name(username).password(password);
+    }
+    connOpts = builder.finalize();
+    new_client->set_callback(*this);
+    {
+        std::lock_guard<std::mutex> lock(client_mutex);
+        client = std::move(new_client);
+    }
+    latency.reset();
+    topics.clear();
+    search.clear();
+    payloads.clear();
+    if (use_consumer_queue){
+        arrived = 0;
+        processed = 0;
+        batches = 0;
+        max_batch = 0;
+        client->start_consuming();
+        consuming = true;
+        worker = std::thread(&Mqttcore::consume_loop, this);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        supervising = true;
+        state = ConnectionState::WAITING;
+        retry_delay = min_retry_delay;
+        retry_time = std::chrono::steady_clock::now();
+    }
+    supervisor = std::thread(&Mqttcore::supervise, this);
+    return true;
+}
+
+/**
+ * Registers watcher of updates of all topics matching filter, see Topicstore::watch_filter.
+ * Every watched filter is subscribed with its own subscription identifier, while connected with MQTT 5
+ * messages are routed to the watcher by the identifier without matching the filter. A filter equal to one
+ * of subscriptions is not subscribed again and its watchers match topics.
+ * @param filter Topic filter with optional + and # wildcards
+ * @param watcher Function called on every update of matching topic
+ * @return Identifier for unwatch
+ */
+int Mqttcore::watch_filter(const std::string& filter, Topicstore::FilterWatcher watcher)
+{
+    if (std::find(subscriptions.begin(), subscriptions.end(), filter) != subscriptions.end()){
+        // Subscription with the same filter would replace the ingested one
+        return topics.watch_filter(filter, std::move(watcher));
+    }
+    int subscription_id;
+    bool subscribe;
+    {
+        std::lock_guard<std::mutex> lock(routed_mutex);
+        RoutedFilter& routed = routed_filters[filter];
+        subscribe = routed.watchers == 0;
+        if (routed.subscription_id == 0){
+            routed.subscription_id = next_subscription_id++;
+        }
+        routed.watchers++;
+        subscription_id = routed.subscription_id;
+    }
+    int id = topics.watch_filter(filter, std::move(watcher), subscription_id);
+    {
+        std::lock_guard<std::mutex> lock(routed_mutex);
+        routed_watches[id] = filter;
+    }
+    if (subscribe && routing){
+        subscribe_routed(filter, subscription_id);
+    }
+    return id;
+}
+
+/**
+ * Removes watcher registered by watch or watch_filter, subscription of a filter is removed with its last watcher
+ * @param id Identifier returned by watch or watch_filter
+ */
+void Mqttcore::unwatch(int id)
+{
+    topics.unwatch(id);
+    std::string filter;
+    {
+        std::lock_guard<std::mutex> lock(routed_mutex);
+        auto watch = routed_watches.find(id);
+        if (watch == routed_watches.end()){
+            return;
+        }
+        filter = watch->second;
+        routed_watches.erase(watch);
+        auto routed = routed_filters.find(filter);
+        if (--routed->second.watchers > 0){
+            return;
+        }
+        routed_filters.erase(routed);
+    }
+    if (!routing){
+        return;
+    }
+    try {
+        client->unsubscribe(filter);
+    } catch (const mqtt::exception&){
+        // Disconnected, the subscription is not restored after connecting
+    }
+}
+
+/**
+ * Subscribes watched filter with subscription identifier, retained messages are requested only for new subscription
+ * @param filter Topic filter
+ * @param subscription_id Identifier attached by the server to messages matching the filter
+ */
+void Mqttcore::subscribe_routed(const std::string& filter, int subscription_id)
+{
+    try {
+        client->subscribe(filter, QOS, mqtt::subscribe_options(false, false, 1),
+                          mqtt::properties{mqtt::property(mqtt::property::SUBSCRIPTION_IDENTIFIER, subscription_id)});
+    } catch (const mqtt::exception&){
+        // Disconnected, subscribed again after connecting
+    }
+}
+
+/**
+ * Creates message object and sends it
+ * @param topic Topic of message
+ * @param value Value of message
+ */
+void Mqttcore::send_message(const std::string& topic,const std::string& value)
+{
+    if(topic.empty()){
+        throw std::invalid_argument("Message topic is empty");
+    }
+    auto msg = mqtt::make_message(topic, value);
+    client->publish(msg);
+}
+
+/**
+ * Publishes content of a file in a background thread, only one file is published at a time
+ * @param topic Topic of message
+ * @param path Path to the file
+ * @param qos Quality of service
+ * @param retained Retain flag
+ * @param on_progress Called from the background thread when the file is mapped, sent, delivered or on failure
+ */
+void Mqttcore::publish_file(const std::string& topic, const std::string& path, int qos, bool retained,
+                            std::function<void(const PublishProgress& progress)> on_progress)
+{
+    if(topic.empty()){
+        throw std::invalid_argument("Message topic is empty");
+    }
+    if (path.empty()){
+        throw std::invalid_argument("File path is empty");
+    }
+    if (publishing_file){
+        throw std::invalid_argument("Previous file is still being published");
+    }
+    if (file_publisher.joinable()){
+        file_publisher.join();
+    }
+    publishing_file = true;
+    cancel_file = false;
+    file_publisher = std::thread(&Mqttcore::publish_file_body, this, topic, path, qos, retained, std::move(on_progress));
+}
+
+/**
+ * Body of file publishing thread. Content of mapped file is copied into the message payload and Paho C
+ * copies it again when sending, the Paho C++ API cannot publish memory it does not own, so the file is
+ * held twice while it is sent. The mapping is released as soon as the payload is created.
+ */
+void Mqttcore::publish_file_body(std::string topic, std::string path, int qos, bool retained,
+                                 std::function<void(const PublishProgress& progress)> on_progress)
+{
+    PublishProgress progress;
+    auto fail = [&](const std::string& error){
+        progress.stage = PublishProgress::FAILED;
+        progress.error = error;
+        publishing_file = false;
+        on_progress(progress);
+    };
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        fail("Unable to open " + path);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        close(fd);
+        fail("Unable to read " + path);
+        return;
+    }
+    progress.bytes = st.st_size;
+    void* map = nullptr;
+    if (progress.bytes > 0){
+        map = mmap(nullptr, progress.bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED){
+        fail("Unable to map " + path);
+        return;
+    }
+    if (map != nullptr){
+        madvise(map, progress.bytes, MADV_SEQUENTIAL);
+    }
+    progress.stage = PublishProgress::MAPPED;
+    on_progress(progress);
+
+    mqtt::delivery_token_ptr token;
+    try {
+        auto msg = mqtt::make_message(topic, map, progress.bytes, qos, retained);
+        if (map != nullptr){
+            munmap(map, progress.bytes);
+            map = nullptr;
+        }
+        token = client->publish(msg);
+    } catch (const mqtt::exception& exc){
+        if (map != nullptr){
+            munmap(map, progress.bytes);
+        }
+        fail(exc.what());
+        return;
+    }
+    progress.stage = PublishProgress::SENT;
+    on_progress(progress);
+
+    try {
+        while (!token->wait_for(std::chrono::milliseconds(200))){
+            if (cancel_file){
+                fail("Publishing cancelled");
+                return;
+            }
+        }
+    } catch (const mqtt::exception& exc){
+        fail(exc.what());
+        return;
+    }
+    progress.stage = PublishProgress::DELIVERED;
+    publishing_file = false;
+    on_progress(progress);
+}
+
+/**
+ * Abandons waiting for delivery of published file and joins its thread
+ */
+void Mqttcore::stop_file_publisher()
+{
+    cancel_file = true;
+    if (file_publisher.joinable()){
+        file_publisher.join();
+    }
+}
+
+/**
+ * Reads batch script. Every line is "<topic> <qos> <retain 0/1> <payload>", payload is the rest of the line
+ * where \n stands for new line and \\ for backslash. Line "RATE <messages per second>" limits publishing rate,
+ * empty lines and lines starting with # are ignored.
+ * @param script Script text
+ * @param rate Output rate limit, 0 if not set
+ * @return Messages in order of the script
+ */
+std::vector<BatchEntry> Mqttcore::parse_batch_script(std::istream& script, double& rate)
+{
+    std::vector<BatchEntry> entries;
+    std::string line;
+    rate = 0;
+    for (int number = 1; std::getline(script, line); number++){
+        if (!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+        std::istringstream fields(line);
+        BatchEntry entry;
+        fields >> entry.topic;
+        if (entry.topic == "RATE"){
+            if (!(fields >> rate) || rate < 0){
+                throw std::invalid_argument("Invalid rate on line " + std::to_string(number));
+            }
+            continue;
+        }
+        if (!(fields >> entry.qos >> entry.retained) || entry.qos < 0 || entry.qos > 2){
+            throw std::invalid_argument("Invalid message on line " + std::to_string(number));
+        }
+        if (fields.peek() == ' '){
+            fields.get();
+        }
+        std::string payload((std::istreambuf_iterator<char>(fields)), std::istreambuf_iterator<char>());
+        entry.payload.reserve(payload.size());
+        for (size_t i = 0; i < payload.size(); i++){
+            if (payload[i] == '\\' && i + 1 < payload.size()){
+                i++;
+                entry.payload += payload[i] == 'n' ? '\n' : payload[i];
+            } else {
+                entry.payload += payload[i];
+            }
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+/**
+ * Publishes messages in a background thread with at most window messages waiting for delivery,
+ * only one batch is published at a time
+ * @param entries Messages to publish
+ * @param rate Maximal rate in messages per second, 0 for unlimited
+ * @param window Maximal number of messages waiting for delivery
+ * @param on_progress Called from the background thread periodically and when the batch is finished
+ */
+void Mqttcore::publish_batch(std::vector<BatchEntry> entries, double rate, size_t window,
+                             std::function<void(const BatchProgress& progress)> on_progress)
+{
+    if (publishing_batch){
+        throw std::invalid_argument("Previous batch is still being published");
+    }
+    if (batch_publisher.joinable()){
+        batch_publisher.join();
+    }
+    publishing_batch = true;
+    cancel_batch_flag = false;
+    batch_publisher = std::thread(&Mqttcore::publish_batch_body, this, std::move(entries), rate,
+                                  std::max<size_t>(1, window), std::move(on_progress));
+}
+
+/**
+ * Body of batch publishing thread
+ */
+void Mqttcore::publish_batch_body(std::vector<BatchEntry> entries, double rate, size_t window,
+                                  std::function<void(const BatchProgress& progress)> on_progress)
+{
+    BatchProgress progress;
+    progress.total = entries.size();
+    std::deque<mqtt::delivery_token_ptr> inflight;
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
+
+    auto fail = [&](const std::string& error){
+        progress.failed++;
+        if (progress.error.empty()){
+            progress.error = error;
+        }
+    };
+    // Waits for the oldest message, returns false when cancelled
+    auto complete_oldest = [&](){
+        try {
+            while (!inflight.front()->wait_for(std::chrono::milliseconds(200))){
+                if (cancel_batch_flag){
+                    return false;
+                }
+            }
+            progress.delivered++;
+        } catch (const mqtt::exception& exc){
+            fail(exc.what());
+        }
+        inflight.pop_front();
+        return true;
+    };
+    auto report = [&](bool finished){
+        auto now = std::chrono::steady_clock::now();
+        progress.seconds = std::chrono::duration<double>(now - start).count();
+        progress.finished = finished;
+        last_report = now;
+        if (finished){
+            publishing_batch = false;
+        }
+        on_progress(progress);
+    };
+
+    for (size_t i = 0; i < entries.size() && !cancel_batch_flag; i++){
+        if (rate > 0){
+            // Sleeps in slices like the delivery wait, so cancelling does not wait for a slow rate
+            auto next = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(i / rate));
+            auto now = std::chrono::steady_clock::now();
+            while (now < next && !cancel_batch_flag){
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(next - now,
+                                                                                          std::chrono::milliseconds(200)));
+                now = std::chrono::steady_clock::now();
+            }
+            if (cancel_batch_flag){
+                break;
+            }
+        }
+        while (inflight.size() >= window){
+            if (!complete_oldest()){
+                break;
+            }
+        }
+        if (cancel_batch_flag){
+            break;
+        }
+        const BatchEntry& entry = entries[i];
+        try {
+            if (entry.topic.empty()){
+                throw std::invalid_argument("Message topic is empty");
+            }
+            inflight.push_back(client->publish(mqtt::make_message(entry.topic, entry.payload, entry.qos, entry.retained)));
+            progress.sent++;
+        } catch (const mqtt::exception& exc){
+            fail(exc.what());
+        } catch (const std::invalid_argument& exc){
+            fail(exc.what());
+        }
+        if (std::chrono::steady_clock::now() - last_report > std::chrono::milliseconds(100)){
+            report(false);
+        }
+    }
+    while (!inflight.empty() && !cancel_batch_flag){
+        complete_oldest();
+    }
+    if (cancel_batch_flag){
+        progress.failed += progress.total - progress.delivered - progress.failed;
+        if (progress.error.empty()){
+            progress.error = "Publishing cancelled";
+        }
+    }
+    report(true);
+}
+
+/**
+ * Stops publishing of current batch, remaining messages are counted as failed
+ */
+void Mqttcore::cancel_batch()
+{
+    cancel_batch_flag = true;
+    if (batch_publisher.joinable()){
+        batch_publisher.join();
+    }
+}
+
+/**
+ * Stops reconnecting and consuming messages, discards any unread messages and disconnects from server
+ */
+void Mqttcore::stop()
+{
+    capture.stop();
+    stop_file_publisher();
+    cancel_batch();
+    stop_supervisor();
+    stop_worker();
+    if (client){
+        client->stop_consuming();
+        try {
+            if (client->is_connected()){
+                disconnect_token = client->disconnect();
+            }
+        } catch (const mqtt::exception&){
+        }
+    }
+    notify_state(ConnectionState::DISCONNECTED, "Disconnected");
+}
+
+/**
+ * Takes messages from consuming queue and processes them in batches until stop_worker is called
+ */
+void Mqttcore::consume_loop()
+{
+    std::vector<mqtt::const_message_ptr> batch;
+    batch.reserve(batch_size);
+    while (consuming){
+        mqtt::const_message_ptr msg;
+        if (!client->try_consume_message_for(&msg, std::chrono::milliseconds(100))){
+            continue;
+        }
+        batch.push_back(std::move(msg));
+        while (batch.size() < batch_size && client->try_consume_message(&msg)){
+            batch.push_back(std::move(msg));
+        }
+        size_t messages = 0;
+        for (auto& it: batch){
+            // Empty message signals connection loss, it is not counted as arrived
+            if (it){
+                ingest(std::move(it));
+                messages++;
+            }
+        }
+        processed += messages;
+        batches++;
+        if (batch.size() > max_batch){
+            max_batch = batch.size();
+        }
+        batch.clear();
+    }
+}
+
+/**
+ * Joins ingestion worker, messages left in the queue are discarded
+ */
+void Mqttcore::stop_worker()
+{
+    consuming = false;
+    if (worker.joinable()){
+        worker.join();
+    }
+}
+
+/**
+ * @return Counters of ingestion worker, queue depth shows whether processing falls behind
+ */
+IngestStats Mqttcore::ingest_stats() const
+{
+    IngestStats stats;
+    stats.processed = processed;
+    stats.arrived = arrived;
+    stats.batches = batches;
+    stats.max_batch = max_batch;
+    return stats;
+}
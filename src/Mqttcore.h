@@ -0,0 +1,221 @@
+/** @file Mqttcore.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include "mqtt/async_client.h"
+#include "Latency.h"
+#include "Capturewriter.h"
+#include "Topicstore.h"
+#include "Searchindex.h"
+#include "Payloadstore.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/** State of connection to the server */
+enum class ConnectionState{
+    DISCONNECTED,  ///< Not connected and not trying to connect
+    CONNECTING,    ///< Connection attempt in progress
+    CONNECTED,
+    WAITING        ///< Waiting before next connection attempt
+};
+
+/** Counters of ingestion worker */
+struct IngestStats{
+    uint64_t arrived = 0;    ///< Messages put into consuming queue by the network thread
+    uint64_t processed = 0;  ///< Messages processed by the worker
+    uint64_t batches = 0;    ///< Number of processed batches
+    size_t max_batch = 0;    ///< Largest processed batch
+    /** @return Messages waiting in the consuming queue */
+    uint64_t queued() const { return arrived > processed ? arrived - processed : 0; }
+};
+
+/** Progress of publishing a file */
+struct PublishProgress{
+    enum Stage{
+        MAPPED,     ///< File is mapped into memory
+        SENT,       ///< Message is handed to the client
+        DELIVERED,  ///< Delivery token completed
+        FAILED
+    };
+    Stage stage;
+    size_t bytes = 0;   ///< Size of file
+    std::string error;  ///< Reason of failure
+};
+
+/** One message of batch publishing */
+struct BatchEntry{
+    std::string topic;
+    std::string payload;
+    int qos = 1;
+    bool retained = false;
+};
+
+/** Default number of batch messages waiting for delivery at the same time */
+const size_t BATCH_WINDOW = 64;
+
+/** Progress and result of batch publishing */
+struct BatchProgress{
+    size_t total = 0;
+    size_t sent = 0;       ///< Messages handed to the client
+    size_t delivered = 0;  ///< Completed delivery tokens
+    size_t failed = 0;     ///< Messages rejected by the client or with failed token
+    double seconds = 0;    ///< Time since start
+    bool finished = false;
+    std::string error;     ///< First failure
+    /** @return Delivered messages per second */
+    double rate() const { return seconds > 0 ? delivered / seconds : 0; }
+};
+
+/**
+ * Connection and message ingestion without any GUI dependency, shared by explorer and command line client.
+ * Received messages update latency statistics, capture recording and topic store, then they are passed to process_message.
+ * By default this happens in the Paho callback thread, with use_consumer_queue messages are taken from
+ * Paho consuming queue by a dedicated worker thread in batches so slow processing does not block the network.
+ * Connecting does not block, a supervisor thread repeats failed attempts and reconnects after connection loss
+ * with exponentially growing delay and subscriptions are restored unless the server kept the session.
+ * With MQTT 5 every filter passed to watch_filter gets its own subscription with a subscription identifier,
+ * the server attaches identifiers of matching subscriptions to messages and filter watchers are routed by them.
+ * Filters in subscriptions share one identifier, so messages are ingested once even when the server sends a copy
+ * for every matching subscription.
+ */
+class Mqttcore : public virtual mqtt::callback, public virtual mqtt::iaction_listener{
+protected:
+    std::unique_ptr<mqtt::async_client> client;
+    mqtt::connect_options connOpts;
+
+public:
+    LatencyTracker latency;
+    CaptureWriter capture;
+    Topicstore topics;
+    Searchindex search;
+    /** Shares identical payloads of all received messages */
+    Payloadstore payloads;
+    /** Topic filters subscribed after connecting */
+    std::vector<std::string> subscriptions{"#"};
+    /** Process messages in worker thread, applied on next connect */
+    bool use_consumer_queue = false;
+    /** Maximal number of messages processed in one batch */
+    size_t batch_size = 256;
+    /** Ask server to keep session and subscriptions between connections, applied on next connect */
+    bool persistent_session = false;
+    /**
+     * Client identifier, applied on next connect. Empty picks PERSISTENT_CLIENT_ID with persistent session,
+     * otherwise an identifier unique to the process, so instances on one server do not take over each other
+     */
+    std::string client_id;
+    /** Default client identifier of persistent session, the session belongs to it */
+    static const char PERSISTENT_CLIENT_ID[];
+    /** Strip simulator latency headers from payloads and record latency, set before connect */
+    bool measure_latency = false;
+    /** Connect with MQTT 5 and route filter watchers by subscription identifiers, applied on next connect */
+    bool use_mqtt5 = false;
+    /** Delay before first retry, doubled after every failed attempt */
+    std::chrono::milliseconds min_retry_delay{500};
+    /** Upper limit of retry delay */
+    std::chrono::milliseconds max_retry_delay{std::chrono::seconds(60)};
+    /** Handler of connection state changes, receives the new state with human readable detail */
+    using StateHandler = std::function<void(ConnectionState state, const std::string& detail)>;
+
+    Mqttcore() = default;
+    virtual ~Mqttcore();
+    bool connect(const std::string& server_address, std::string server_port,
+                 const std::string& username, const std::string& password);
+    void stop();
+    ConnectionState connection_state() const;
+    void set_state_handler(StateHandler handler);
+    void send_message(const std::string& topic,const std::string& value);
+    void publish_file(const std::string& topic, const std::string& path, int qos, bool retained,
+                      std::function<void(const PublishProgress& progress)> on_progress);
+    static std::vector<BatchEntry> parse_batch_script(std::istream& script, double& rate);
+    void publish_batch(std::vector<BatchEntry> entries, double rate, size_t window,
+                       std::function<void(const BatchProgress& progress)> on_progress);
+    void cancel_batch();
+    IngestStats ingest_stats() const;
+    int watch_filter(const std::string& filter, Topicstore::FilterWatcher watcher);
+    void unwatch(int id);
+
+    // Callback functions
+    void message_arrived(mqtt::const_message_ptr msg) override;
+    void on_success(const mqtt::token &asyncActionToken) override;
+    void on_failure(const mqtt::token &asyncActionToken) override;
+    void connection_lost(const std::string& cause) override;
+    void connected(const std::string &what) override;
+
+protected:
+    void stop_worker();
+
+    /**
+     * Called for every received message after ingestion
+     * @param msg Received message with latency header removed
+     * @param received_time Time of arrival
+     */
+    virtual void process_message(mqtt::const_message_ptr /*msg*/,
+                                 std::chrono::time_point<std::chrono::system_clock> /*received_time*/) {}
+
+private:
+    std::thread supervisor;
+    mutable std::mutex state_mutex;
+    std::condition_variable state_cv;
+    ConnectionState state = ConnectionState::DISCONNECTED;
+    bool supervising = false;
+    std::chrono::milliseconds retry_delay{0};
+    std::chrono::steady_clock::time_point retry_time;
+    mqtt::token_ptr disconnect_token;
+    /** Guards replacement of client against late action callbacks of the previous one */
+    std::mutex client_mutex;
+    /** Guards on_state_changed, held while it runs */
+    std::mutex handler_mutex;
+    StateHandler on_state_changed;
+
+    std::thread file_publisher;
+    std::atomic<bool> publishing_file{false};
+    std::atomic<bool> cancel_file{false};
+
+    std::thread batch_publisher;
+    std::atomic<bool> publishing_batch{false};
+    std::atomic<bool> cancel_batch_flag{false};
+
+    /** Server subscription of a watched filter */
+    struct RoutedFilter{
+        int subscription_id = 0;
+        int watchers = 0;
+    };
+    /** Guards routed filters, subscription identifiers are kept for the whole lifetime */
+    std::mutex routed_mutex;
+    std::unordered_map<std::string, RoutedFilter> routed_filters;
+    /** Filter of every watch id registered through watch_filter */
+    std::unordered_map<int, std::string> routed_watches;
+    /** Identifier 1 belongs to subscriptions */
+    int next_subscription_id = 2;
+    /** Connected with MQTT 5 to a server supporting subscription identifiers */
+    std::atomic<bool> routing{false};
+
+    std::thread worker;
+    std::atomic<bool> consuming{false};
+    std::atomic<uint64_t> arrived{0};
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<size_t> max_batch{0};
+
+    void ingest(mqtt::const_message_ptr msg);
+    void subscribe_routed(const std::string& filter, int subscription_id);
+    void consume_loop();
+    void publish_file_body(std::string topic, std::string path, int qos, bool retained,
+                           std::function<void(const PublishProgress& progress)> on_progress);
+    void stop_file_publisher();
+    void publish_batch_body(std::vector<BatchEntry> entries, double rate, size_t window,
+                            std::function<void(const BatchProgress& progress)> on_progress);
+    void supervise();
+    void stop_supervisor();
+    void release_client();
+    void schedule_retry(const std::string& cause);
+    void notify_state(ConnectionState new_state, const std::string& detail);
+};
@@ -0,0 +1,80 @@
+/** @file Payloadstore.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Payloadstore.h"
+#include <algorithm>
+#include <functional>
+
+const size_t Payloadstore::MAX_INTERNED;
+
+/**
+ * Finds shared copy of payload, unknown payloads are added to the store
+ * @param payload Received payload
+ * @return Shared payload with the same content, or payload itself
+ */
+mqtt::binary_ref Payloadstore::intern(const mqtt::binary_ref& payload)
+{
+    if (!payload || payload.size() > MAX_INTERNED){
+        return payload;
+    }
+    const std::string& content = payload.str();
+    size_t hash = std::hash<std::string>()(content);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto range = payloads.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it){
+        auto shared = it->second.lock();
+        if (shared && (shared == payload.ptr() || *shared == content)){
+            if (shared != payload.ptr()){
+                counters.duplicates++;
+                counters.saved_bytes += content.size();
+            }
+            return mqtt::binary_ref(shared);
+        }
+    }
+    payloads.emplace(hash, payload.ptr());
+    if (payloads.size() >= purge_size){
+        purge();
+    }
+    return payload;
+}
+
+/** Forgets all payloads, payloads in use stay valid */
+void Payloadstore::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    payloads.clear();
+    purge_size = 1024;
+    counters = Stats();
+}
+
+/** @return Current counters */
+Payloadstore::Stats Payloadstore::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = counters;
+    result.distinct = 0;
+    for (const auto& it: payloads){
+        if (!it.second.expired()){
+            result.distinct++;
+        }
+    }
+    return result;
+}
+
+/**
+ * Removes references of freed payloads, next purge happens when the store doubles
+ */
+void Payloadstore::purge()
+{
+    for (auto it = payloads.begin(); it != payloads.end();){
+        if (it->second.expired()){
+            it = payloads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    purge_size = std::max<size_t>(1024, payloads.size() * 2);
+}
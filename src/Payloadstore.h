@@ -0,0 +1,43 @@
+/** @file Payloadstore.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include "mqtt/async_client.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Content addressed store of received payloads. Identical payloads of all topics are shared, the store
+ * only keeps weak references so a payload is freed when the last message, history entry or index using
+ * it is gone.
+ */
+class Payloadstore{
+public:
+    /** Counters of interning */
+    struct Stats{
+        size_t distinct = 0;       ///< Payloads currently in the store
+        uint64_t duplicates = 0;   ///< Payloads replaced by a shared copy
+        uint64_t saved_bytes = 0;  ///< Bytes of replaced payloads
+    };
+
+    /** Larger payloads are not interned, hashing them costs more than it saves */
+    static const size_t MAX_INTERNED = 65536;
+
+    mqtt::binary_ref intern(const mqtt::binary_ref& payload);
+    void clear();
+    Stats stats() const;
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_multimap<size_t, std::weak_ptr<const std::string>> payloads;
+    /** Size of payloads at which expired references are removed */
+    size_t purge_size = 1024;
+    Stats counters;
+
+    void purge();
+};
@@ -0,0 +1,236 @@
+/** @file Searchindex.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Searchindex.h"
+#include <algorithm>
+
+namespace {
+
+/** @return ASCII lower case of character */
+unsigned char lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : static_cast<unsigned char>(c);
+}
+
+/**
+ * Lists distinct trigrams of text
+ * @param data Text
+ * @param size Length of text
+ * @return Sorted trigram keys, three lower case bytes packed into integer
+ */
+std::vector<uint32_t> trigrams(const char* data, size_t size)
+{
+    std::vector<uint32_t> keys;
+    if (size < 3){
+        return keys;
+    }
+    keys.reserve(size - 2);
+    for (size_t i = 0; i + 2 < size; i++){
+        keys.push_back(uint32_t(lower(data[i])) << 16 | uint32_t(lower(data[i + 1])) << 8 | lower(data[i + 2]));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+}
+
+const size_t Searchindex::MAX_INDEXED;
+
+/**
+ * Indexes received message, binary payloads are skipped and nothing is indexed when max_messages is 0
+ * @param topic Full topic name
+ * @param payload Message payload, shared with the message
+ * @param received_time Time of arrival
+ */
+void Searchindex::add(const std::string& topic, const mqtt::binary_ref& payload,
+                      std::chrono::time_point<std::chrono::system_clock> received_time)
+{
+    if (max_messages == 0 || !payload || payload.empty()){
+        return;
+    }
+    size_t size = std::min(payload.size(), MAX_INDEXED);
+    if (!is_text(payload.data(), size)){
+        return;
+    }
+    auto keys = trigrams(payload.data(), size);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto topic_id = topic_ids.find(topic);
+    if (topic_id == topic_ids.end()){
+        topic_id = topic_ids.emplace(topic, static_cast<uint32_t>(topic_names.size())).first;
+        topic_names.push_back(topic);
+    }
+    uint64_t id = first_id + documents.size();
+    documents.push_back(Document{topic_id->second, received_time, resolver ? mqtt::binary_ref() : payload, payload.ptr()});
+    for (uint32_t key: keys){
+        postings[key].push_back(id);
+    }
+    while (documents.size() > max_messages){
+        documents.pop_front();
+        first_id++;
+        stale++;
+    }
+    if (stale > max_messages / 2){
+        prune();
+    }
+}
+
+/**
+ * Finds messages containing text, ignoring ASCII case
+ * @param text Searched text
+ * @param limit Maximal number of results
+ * @return Matching messages, newest first
+ */
+std::vector<Searchindex::Result> Searchindex::search(const std::string& text, size_t limit) const
+{
+    std::vector<Result> results;
+    std::string lower_text;
+    for (char c: text){
+        lower_text += static_cast<char>(lower(c));
+    }
+    if (lower_text.empty() || lower_text.size() > MAX_INDEXED){
+        return results;
+    }
+    auto add_result = [&](const Document& document){
+        results.push_back(Result{topic_names[document.topic], document.received_time, payload(document)});
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto keys = trigrams(lower_text.data(), lower_text.size());
+    if (keys.empty()){
+        // Text too short for trigrams
+        for (auto it = documents.rbegin(); it != documents.rend() && results.size() < limit; ++it){
+            if (contains(payload(*it), lower_text)){
+                add_result(*it);
+            }
+        }
+        return results;
+    }
+
+    std::vector<const std::vector<uint64_t>*> lists;
+    for (uint32_t key: keys){
+        auto it = postings.find(key);
+        if (it == postings.end()){
+            return results;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint64_t>* a, const std::vector<uint64_t>* b){
+        return a->size() < b->size();
+    });
+    const std::vector<uint64_t>& shortest = *lists.front();
+    for (auto it = shortest.rbegin(); it != shortest.rend() && results.size() < limit; ++it){
+        uint64_t id = *it;
+        if (id < first_id){
+            break;
+        }
+        bool candidate = std::all_of(lists.begin() + 1, lists.end(), [id](const std::vector<uint64_t>* list){
+            return std::binary_search(list->begin(), list->end(), id);
+        });
+        const Document& document = documents[id - first_id];
+        if (candidate && contains(payload(document), lower_text)){
+            add_result(document);
+        }
+    }
+    return results;
+}
+
+/** Removes all messages */
+void Searchindex::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    documents.clear();
+    postings.clear();
+    topic_names.clear();
+    topic_ids.clear();
+    first_id = 0;
+    stale = 0;
+}
+
+/** @return Number of indexed messages */
+size_t Searchindex::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return documents.size();
+}
+
+/**
+ * Sets lookup of payloads freed by their owner, afterwards indexed messages hold only weak references
+ * @param payload_resolver Payload lookup called during search with the index locked
+ */
+void Searchindex::set_resolver(Resolver payload_resolver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resolver = std::move(payload_resolver);
+    for (auto& document: documents){
+        document.payload = mqtt::binary_ref();
+    }
+}
+
+/**
+ * Payload of indexed message, from the resolver if nobody else holds it any more
+ * @param document Indexed message
+ * @return Payload, empty if it cannot be resolved
+ */
+mqtt::binary_ref Searchindex::payload(const Document& document) const
+{
+    if (document.payload){
+        return document.payload;
+    }
+    auto shared = document.shared_payload.lock();
+    if (shared){
+        return mqtt::binary_ref(shared);
+    }
+    return resolver ? resolver(topic_names[document.topic], document.received_time) : mqtt::binary_ref();
+}
+
+/**
+ * Checks whether payload looks like text
+ * @param data Payload
+ * @param size Checked length
+ * @return False if payload contains control characters other than white space
+ */
+bool Searchindex::is_text(const char* data, size_t size)
+{
+    return std::none_of(data, data + size, [](char c){
+        return static_cast<unsigned char>(c) < 0x20 && c != '\t' && c != '\n' && c != '\r';
+    });
+}
+
+/**
+ * Checks whether indexed part of payload contains text
+ * @param payload Message payload
+ * @param lower_text Lower case searched text
+ * @return True if text was found ignoring ASCII case
+ */
+bool Searchindex::contains(const mqtt::binary_ref& payload, const std::string& lower_text)
+{
+    if (!payload){
+        return false;
+    }
+    const char* data = payload.data();
+    const char* end = data + std::min(payload.size(), MAX_INDEXED);
+    return std::search(data, end, lower_text.begin(), lower_text.end(), [](char a, char b){
+        return lower(a) == static_cast<unsigned char>(b);
+    }) != end;
+}
+
+/**
+ * Drops pruned messages from posting lists
+ */
+void Searchindex::prune()
+{
+    for (auto it = postings.begin(); it != postings.end();){
+        auto& list = it->second;
+        list.erase(list.begin(), std::lower_bound(list.begin(), list.end(), first_id));
+        if (list.empty()){
+            it = postings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    stale = 0;
+}
@@ -0,0 +1,76 @@
+/** @file Searchindex.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include "mqtt/async_client.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Incremental full-text index over text payloads of received messages. Every message is split into
+ * case insensitive trigrams, each trigram keeps sorted list of messages containing it. Search intersects
+ * lists of query trigrams and verifies the candidates. Only newest max_messages messages are kept,
+ * older ones are dropped from lists in bulk when enough of them accumulate.
+ * With a resolver set, the index does not keep payloads alive, payloads freed by their owner are
+ * obtained from the resolver.
+ */
+class Searchindex{
+public:
+    /** Found message */
+    struct Result{
+        std::string topic;
+        std::chrono::time_point<std::chrono::system_clock> received_time;
+        mqtt::binary_ref payload;
+    };
+
+    /** Looks up payload of indexed message whose shared payload was freed, returns empty if unknown */
+    using Resolver = std::function<mqtt::binary_ref(const std::string& topic,
+                                                    std::chrono::time_point<std::chrono::system_clock> received_time)>;
+
+    /** Number of payload bytes indexed from the start of every message */
+    static const size_t MAX_INDEXED = 4096;
+
+    /** Number of kept messages, older messages are pruned, 0 disables indexing */
+    size_t max_messages = 1000000;
+
+    void add(const std::string& topic, const mqtt::binary_ref& payload,
+             std::chrono::time_point<std::chrono::system_clock> received_time);
+    std::vector<Result> search(const std::string& text, size_t limit) const;
+    void clear();
+    size_t size() const;
+    void set_resolver(Resolver payload_resolver);
+
+private:
+    struct Document{
+        uint32_t topic;
+        std::chrono::time_point<std::chrono::system_clock> received_time;
+        /** Payload kept by the index, empty when resolver is set */
+        mqtt::binary_ref payload;
+        std::weak_ptr<const std::string> shared_payload;
+    };
+
+    mutable std::mutex mutex;
+    /** Messages ordered by id, front has id first_id */
+    std::deque<Document> documents;
+    uint64_t first_id = 0;
+    /** Messages pruned from documents but still present in postings */
+    size_t stale = 0;
+    std::unordered_map<uint32_t, std::vector<uint64_t>> postings;
+    std::vector<std::string> topic_names;
+    std::unordered_map<std::string, uint32_t> topic_ids;
+    Resolver resolver;
+
+    mqtt::binary_ref payload(const Document& document) const;
+    static bool is_text(const char* data, size_t size);
+    static bool contains(const mqtt::binary_ref& payload, const std::string& lower_text);
+    void prune();
+};
@@ -0,0 +1,43 @@
+/** @file Topicfilter.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Matching of MQTT topic filters shared by the explorer and the loopback broker, without Paho dependency.
+ */
+
+#pragma once
+#include <string>
+
+/**
+ * Matches topic name against MQTT topic filter
+ * @param filter Topic filter with optional + and # wildcards
+ * @param topic Full topic name
+ * @return True if topic matches filter
+ */
+inline bool topic_matches(const std::string& filter, const std::string& topic)
+{
+    // Wildcards at first level do not match topics starting with $
+    if (!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')){
+        return false;
+    }
+    size_t f = 0, t = 0;
+    while (f < filter.size()){
+        if (filter[f] == '#'){
+            return true;
+        }
+        if (filter[f] == '+'){
+            while (t < topic.size() && topic[t] != '/'){
+                t++;
+            }
+            f++;
+        } else {
+            if (t >= topic.size() || filter[f] != topic[t]){
+                // "a/#" also matches parent level "a"
+                return t == topic.size() && filter.compare(f, std::string::npos, "/#") == 0;
+            }
+            f++;
+            t++;
+        }
+    }
+    return t == topic.size();
+}
@@ -0,0 +1,201 @@
+/** @file Topicstore.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "Topicstore.h"
+#include <algorithm>
+
+/**
+ * Updates topic with received message
+ * @param topic Full topic name
+ * @param payload Message payload, shared with the message
+ * @param received_time Time of arrival
+ * @param subscription_ids Subscription identifiers of the message, nullptr if the server does not send them
+ */
+void Topicstore::update(const std::string& topic, const mqtt::binary_ref& payload,
+                        std::chrono::time_point<std::chrono::system_clock> received_time,
+                        const std::vector<int>* subscription_ids)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry& entry = topics[topic];
+        entry.messages++;
+        entry.bytes += payload.size();
+        entry.latest = payload;
+        entry.received_time = received_time;
+    }
+    if (watcher_count == 0){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    auto it = watchers.find(topic);
+    if (it != watchers.end()){
+        for (const auto& watcher: it->second){
+            watcher.second(payload, received_time);
+        }
+    }
+    for (const auto& watch: filter_watchers){
+        bool matches = (subscription_ids != nullptr && watch.subscription_id != 0)
+                ? std::find(subscription_ids->begin(), subscription_ids->end(), watch.subscription_id) != subscription_ids->end()
+                : topic_matches(watch.filter, topic);
+        if (matches){
+            watch.watcher(topic, payload);
+        }
+    }
+}
+
+/**
+ * Notifies filter watchers registered with subscription identifier without updating the topic,
+ * used for a message copy the server sent only for subscriptions of watched filters
+ * @param topic Full topic name
+ * @param payload Message payload
+ * @param subscription_ids Subscription identifiers of the message
+ */
+void Topicstore::notify_routed(const std::string& topic, const mqtt::binary_ref& payload,
+                               const std::vector<int>& subscription_ids)
+{
+    if (watcher_count == 0){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    for (const auto& watch: filter_watchers){
+        if (watch.subscription_id != 0
+                && std::find(subscription_ids.begin(), subscription_ids.end(), watch.subscription_id) != subscription_ids.end()){
+            watch.watcher(topic, payload);
+        }
+    }
+}
+
+/**
+ * Looks up latest value of topic
+ * @param topic Full topic name
+ * @param payload Output latest payload
+ * @param received_time Output time of arrival of latest payload
+ * @return False if no message of topic was received
+ */
+bool Topicstore::latest(const std::string& topic, mqtt::binary_ref& payload,
+                        std::chrono::time_point<std::chrono::system_clock>& received_time) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = topics.find(topic);
+    if (it == topics.end()){
+        return false;
+    }
+    payload = it->second.latest;
+    received_time = it->second.received_time;
+    return true;
+}
+
+/**
+ * Registers watcher of topic updates, watcher must not call watch or unwatch
+ * @param topic Full topic name, wildcards are not supported
+ * @param watcher Function called on every update of topic
+ * @return Identifier for unwatch
+ */
+int Topicstore::watch(const std::string& topic, Watcher watcher)
+{
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    int id = next_watch_id++;
+    watchers[topic].emplace_back(id, std::move(watcher));
+    watcher_count++;
+    return id;
+}
+
+/**
+ * Registers watcher of updates of all topics matching filter. Watcher is first called with latest
+ * payload of every already known matching topic. Watcher must not call any method of the store.
+ * @param filter Topic filter with optional + and # wildcards
+ * @param watcher Function called on every update of matching topic
+ * @param subscription_id Identifier of server subscription of the filter, 0 if messages are matched against the filter
+ * @return Identifier for unwatch
+ */
+int Topicstore::watch_filter(const std::string& filter, FilterWatcher watcher, int subscription_id)
+{
+    std::lock_guard<std::mutex> watch_lock(watch_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& it: topics){
+            if (topic_matches(filter, it.first)){
+                watcher(it.first, it.second.latest);
+            }
+        }
+    }
+    int id = next_watch_id++;
+    filter_watchers.push_back({id, filter, subscription_id, std::move(watcher)});
+    watcher_count++;
+    return id;
+}
+
+/**
+ * Removes watcher, after return the watcher is not running and will not be called again
+ * @param id Identifier returned by watch
+ */
+void Topicstore::unwatch(int id)
+{
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    for (auto it = filter_watchers.begin(); it != filter_watchers.end(); ++it){
+        if (it->id == id){
+            filter_watchers.erase(it);
+            watcher_count--;
+            return;
+        }
+    }
+    for (auto it = watchers.begin(); it != watchers.end(); ++it){
+        auto& list = it->second;
+        for (auto watcher = list.begin(); watcher != list.end(); ++watcher){
+            if (watcher->first == id){
+                list.erase(watcher);
+                if (list.empty()){
+                    watchers.erase(it);
+                }
+                watcher_count--;
+                return;
+            }
+        }
+    }
+}
+
+/** Removes all topics, watchers stay registered */
+void Topicstore::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    topics.clear();
+}
+
+/** @return Number of known topics */
+size_t Topicstore::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return topics.size();
+}
+
+/**
+ * Computes rates since previous sample and returns busiest topics
+ * @param seconds Time elapsed since previous sample
+ * @param top Maximum number of returned topics
+ * @param by_bytes Order by byte rate instead of message rate
+ * @return Busiest topics, busiest first
+ */
+std::vector<Topicstore::Rate> Topicstore::sample(double seconds, size_t top, bool by_bytes)
+{
+    std::vector<Rate> rates;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rates.reserve(topics.size());
+        for (auto& it: topics){
+            Entry& entry = it.second;
+            rates.push_back({it.first, (entry.messages - entry.sampled_messages) / seconds,
+                             (entry.bytes - entry.sampled_bytes) / seconds, entry.messages, entry.bytes});
+            entry.sampled_messages = entry.messages;
+            entry.sampled_bytes = entry.bytes;
+        }
+    }
+    auto busier = [by_bytes](const Rate& a, const Rate& b){
+        return by_bytes ? a.bytes_per_second > b.bytes_per_second : a.messages_per_second > b.messages_per_second;
+    };
+    top = std::min(top, rates.size());
+    std::partial_sort(rates.begin(), rates.begin() + top, rates.end(), busier);
+    rates.resize(top);
+    return rates;
+}
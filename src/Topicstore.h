@@ -0,0 +1,82 @@
+/** @file Topicstore.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#pragma once
+#include "mqtt/async_client.h"
+#include "Topicfilter.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Flat store of all received topics keyed by full topic name, keeps latest value and traffic statistics.
+ * Watchers registered for a full topic name are notified of every update, even when registered before
+ * the first message of the topic arrives or after the store was cleared. Filter watchers are notified
+ * of updates of all topics matching a wildcard filter. A filter watcher registered with subscription
+ * identifier is routed by identifiers the server attached to the message instead of matching the filter.
+ */
+class Topicstore{
+public:
+    /** Statistics of one topic */
+    struct Entry{
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        mqtt::binary_ref latest;
+        std::chrono::time_point<std::chrono::system_clock> received_time;
+
+        uint64_t sampled_messages = 0;  ///< Value of messages at last sample
+        uint64_t sampled_bytes = 0;     ///< Value of bytes at last sample
+    };
+
+    /** Rate of one topic between two samples */
+    struct Rate{
+        std::string topic;
+        double messages_per_second;
+        double bytes_per_second;
+        uint64_t messages;
+        uint64_t bytes;
+    };
+
+    /** Notification of topic update, called from the ingestion thread */
+    using Watcher = std::function<void(const mqtt::binary_ref& payload,
+                                       std::chrono::time_point<std::chrono::system_clock> received_time)>;
+    /** Notification of update of topic matching a filter, called from the ingestion thread */
+    using FilterWatcher = std::function<void(const std::string& topic, const mqtt::binary_ref& payload)>;
+
+    void update(const std::string& topic, const mqtt::binary_ref& payload,
+                std::chrono::time_point<std::chrono::system_clock> received_time,
+                const std::vector<int>* subscription_ids = nullptr);
+    void notify_routed(const std::string& topic, const mqtt::binary_ref& payload,
+                       const std::vector<int>& subscription_ids);
+    void clear();
+    size_t size() const;
+    std::vector<Rate> sample(double seconds, size_t top, bool by_bytes);
+    bool latest(const std::string& topic, mqtt::binary_ref& payload,
+                std::chrono::time_point<std::chrono::system_clock>& received_time) const;
+    int watch(const std::string& topic, Watcher watcher);
+    int watch_filter(const std::string& filter, FilterWatcher watcher, int subscription_id = 0);
+    void unwatch(int id);
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> topics;
+
+    /** Guards watchers, held while notifying so unwatch waits for running notification */
+    std::mutex watch_mutex;
+    std::unordered_map<std::string, std::vector<std::pair<int, Watcher>>> watchers;
+    struct FilterWatch{
+        int id;
+        std::string filter;
+        int subscription_id;
+        FilterWatcher watcher;
+    };
+    std::vector<FilterWatch> filter_watchers;
+    std::atomic<size_t> watcher_count{0};
+    int next_watch_id = 1;
+};
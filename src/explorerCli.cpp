@@ -0,0 +1,216 @@
+/** @file explorerCli.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Headless explorer, subscribes to the server and periodically prints the busiest topics.
+ *  Usage: mqtt-explorer-cli [-h host] [-p port] [-u user] [-P password] [-c client id] [-t filter]... [-n top] [-i seconds] [-b] [-q] [-s] [-5] [-l] [-B] [-f script]
+ */
+
+#include "Mqttcore.h"
+#include "Broker.h"
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+/** Set by signal handler to end the program */
+std::atomic<bool> halt(false);
+
+/**
+ * Handler of SIGINT and SIGTERM
+ */
+void on_signal(int)
+{
+    halt = true;
+}
+
+/**
+ * Prints usage to standard error
+ */
+void usage()
+{
+    std::cerr << "Usage: mqtt-explorer-cli [-h host] [-p port] [-u user] [-P password] [-c client id] [-t filter]... "
+                 "[-n top] [-i seconds] [-b] [-q] [-s] [-5] [-l] [-B] [-f script]\n"
+                 "\t-c  client identifier (default unique per process, fixed with -s)\n"
+                 "\t-t  topic filter to subscribe, may be repeated (default #)\n"
+                 "\t-n  number of printed topics (default 10)\n"
+                 "\t-i  print interval in seconds (default 5)\n"
+                 "\t-b  order topics by byte rate instead of message rate\n"
+                 "\t-q  process messages in worker thread and print queue depth\n"
+                 "\t-s  persistent session, subscriptions are kept by server between connections\n"
+                 "\t-5  connect with MQTT 5\n"
+                 "\t-l  strip simulator latency headers and print latency statistics\n"
+                 "\t-B  start loopback broker on the port in this process and connect to it, print broker counters\n"
+                 "\t-f  publish messages of batch script after connecting, lines \"topic qos retain payload\"\n";
+}
+
+/**
+ * Main body of the program
+ */
+int main(int argc, char* argv[])
+{
+    std::string host = "localhost", port, username, password, client_id, script_path;
+    std::vector<std::string> filters;
+    size_t top = 10;
+    double interval = 5;
+    bool by_bytes = false;
+    bool consumer_queue = false;
+    bool persistent = false;
+    bool mqtt5 = false;
+    bool measure_latency = false;
+    bool embedded_broker = false;
+
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "-b"){
+            by_bytes = true;
+            continue;
+        }
+        if (arg == "-q"){
+            consumer_queue = true;
+            continue;
+        }
+        if (arg == "-s"){
+            persistent = true;
+            continue;
+        }
+        if (arg == "-5"){
+            mqtt5 = true;
+            continue;
+        }
+        if (arg == "-l"){
+            measure_latency = true;
+            continue;
+        }
+        if (arg == "-B"){
+            embedded_broker = true;
+            continue;
+        }
+        if (i + 1 >= argc){
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "-h") host = value;
+            else if (arg == "-p") port = value;
+            else if (arg == "-u") username = value;
+            else if (arg == "-P") password = value;
+            else if (arg == "-c") client_id = value;
+            else if (arg == "-t") filters.push_back(value);
+            else if (arg == "-n") top = std::stoul(value);
+            else if (arg == "-i") interval = std::stod(value);
+            else if (arg == "-f") script_path = value;
+            else {
+                usage();
+                return 1;
+            }
+        } catch (const std::exception&){
+            usage();
+            return 1;
+        }
+    }
+    if (interval <= 0){
+        usage();
+        return 1;
+    }
+
+    std::vector<BatchEntry> batch;
+    double batch_rate = 0;
+    if (!script_path.empty()){
+        std::ifstream script(script_path);
+        try {
+            if (!script){
+                throw std::invalid_argument("Cannot open " + script_path);
+            }
+            batch = Mqttcore::parse_batch_script(script, batch_rate);
+        } catch (const std::invalid_argument& error){
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    Broker broker;
+    if (embedded_broker){
+        try {
+            broker.start("127.0.0.1", static_cast<uint16_t>(port.empty() ? 1883 : std::stoul(port)));
+        } catch (const std::exception& error){
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+        host = "127.0.0.1";
+        port = std::to_string(broker.port());
+    }
+
+    Mqttcore core;
+    core.use_consumer_queue = consumer_queue;
+    core.persistent_session = persistent;
+    core.client_id = client_id;
+    core.use_mqtt5 = mqtt5;
+    core.measure_latency = measure_latency;
+    core.search.max_messages = 0;
+    core.set_state_handler([](ConnectionState, const std::string& detail){
+        std::cerr << detail << std::endl;
+    });
+    if (!filters.empty()){
+        core.subscriptions = filters;
+    }
+    try {
+        core.connect(host, port, username, password);
+    } catch (const mqtt::exception&){
+        return 1;
+    }
+    if (!batch.empty()){
+        while (!halt && core.connection_state() != ConnectionState::CONNECTED){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        core.publish_batch(std::move(batch), batch_rate, BATCH_WINDOW, [](const BatchProgress& progress){
+            if (progress.finished){
+                fprintf(stderr, "batch: %zu/%zu delivered, %zu failed in %.2f s, %.1f msg/s%s%s\n",
+                        progress.delivered, progress.total, progress.failed, progress.seconds, progress.rate(),
+                        progress.error.empty() ? "" : ", ", progress.error.c_str());
+            }
+        });
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    auto last = std::chrono::steady_clock::now();
+    while (!halt){
+        auto next = last + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+        while (!halt && std::chrono::steady_clock::now() < next){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        auto rates = core.topics.sample(seconds, top, by_bytes);
+        printf("\n%zu topics, top %zu by %s\n", core.topics.size(), rates.size(), by_bytes ? "bytes/s" : "msg/s");
+        printf("%12s %14s %12s %14s  %s\n", "msg/s", "bytes/s", "messages", "bytes", "topic");
+        for (const auto& it: rates){
+            printf("%12.1f %14.1f %12llu %14llu  %s\n", it.messages_per_second, it.bytes_per_second,
+                   (unsigned long long)it.messages, (unsigned long long)it.bytes, it.topic.c_str());
+        }
+        if (consumer_queue){
+            IngestStats ingest = core.ingest_stats();
+            printf("queue: %llu waiting, %llu processed in %llu batches, largest batch %zu\n",
+                   (unsigned long long)ingest.queued(), (unsigned long long)ingest.processed,
+                   (unsigned long long)ingest.batches, ingest.max_batch);
+        }
+        if (embedded_broker){
+            BrokerStats stats = broker.stats();
+            printf("broker: %llu clients, %llu received, %llu sent, %llu dropped\n",
+                   (unsigned long long)stats.connections, (unsigned long long)stats.received,
+                   (unsigned long long)stats.sent, (unsigned long long)stats.dropped);
+        }
+        if (!core.latency.empty()){
+            printf("%s", core.latency.report().c_str());
+        }
+        fflush(stdout);
+    }
+    core.stop();
+    return 0;
+}
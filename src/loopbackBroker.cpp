@@ -0,0 +1,108 @@
+/** @file loopbackBroker.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Standalone loopback MQTT broker for local benchmarks of the simulator and explorer, periodically prints traffic counters.
+ *  Usage: mqtt-loopback-broker [-a address] [-p port] [-i seconds]
+ */
+
+#include "Broker.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/** Set by signal handler to end the program */
+std::atomic<bool> halt(false);
+
+/**
+ * Handler of SIGINT and SIGTERM
+ */
+void on_signal(int)
+{
+    halt = true;
+}
+
+/**
+ * Prints usage to standard error
+ */
+void usage()
+{
+    std::cerr << "Usage: mqtt-loopback-broker [-a address] [-p port] [-i seconds]\n"
+                 "\t-a  listening address (default 127.0.0.1)\n"
+                 "\t-p  listening port (default 1883)\n"
+                 "\t-i  print interval in seconds (default 5)\n";
+}
+
+/**
+ * Main body of the program
+ */
+int main(int argc, char* argv[])
+{
+    std::string address = "127.0.0.1";
+    unsigned long port = 1883;
+    double interval = 5;
+
+    for (int i = 1; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        try {
+            if (arg == "-a") address = value;
+            else if (arg == "-p") port = std::stoul(value);
+            else if (arg == "-i") interval = std::stod(value);
+            else {
+                usage();
+                return 1;
+            }
+        } catch (const std::exception&){
+            usage();
+            return 1;
+        }
+    }
+    if (argc % 2 == 0 || interval <= 0 || port > 65535){
+        usage();
+        return 1;
+    }
+
+    Broker broker;
+    try {
+        broker.start(address, static_cast<uint16_t>(port));
+    } catch (const std::runtime_error& error){
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    std::cerr << "Listening on " << address << ":" << broker.port() << std::endl;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    BrokerStats last_stats;
+    auto last = std::chrono::steady_clock::now();
+    while (!halt){
+        auto next = last + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+        while (!halt && std::chrono::steady_clock::now() < next){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        BrokerStats stats = broker.stats();
+        uint64_t received = stats.received - last_stats.received;
+        printf("clients: %llu  in: %.1f msg/s %.1f bytes/s %.1f wire B/msg  out: %.1f msg/s %.1f bytes/s  dropped: %llu  "
+               "subscriptions: %llu  retained: %llu\n",
+               (unsigned long long)stats.connections,
+               received / seconds, (stats.received_bytes - last_stats.received_bytes) / seconds,
+               received ? double(stats.received_wire_bytes - last_stats.received_wire_bytes) / received : 0.0,
+               (stats.sent - last_stats.sent) / seconds, (stats.sent_bytes - last_stats.sent_bytes) / seconds,
+               (unsigned long long)stats.dropped, (unsigned long long)stats.subscriptions,
+               (unsigned long long)stats.retained);
+        fflush(stdout);
+        last_stats = stats;
+    }
+    broker.stop();
+    return 0;
+}
@@ -0,0 +1,300 @@
+/** @file dashboardcanvas.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#include <algorithm>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include "dashboardcanvas.h"
+
+DashboardCanvas::DashboardCanvas(QWidget *parent) : QAbstractScrollArea(parent)
+{
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    verticalScrollBar()->setSingleStep(TILE_HEIGHT / 4);
+    // Repaint of updated tiles is limited to 30 frames per second
+    frameTimer.setInterval(33);
+    connect(&frameTimer, &QTimer::timeout, this, &DashboardCanvas::refreshDirty);
+    frameTimer.start();
+}
+
+DashboardCanvas::~DashboardCanvas()
+{
+    clear();
+}
+
+/**
+ * Sets number of tiles in a row, tiles are rearranged
+ * @param count Number of columns
+ */
+void DashboardCanvas::setColumnCount(int count)
+{
+    std::vector<Slot> old;
+    old.swap(tiles);
+    int oldColumns = columns;
+    columns = std::max(1, count);
+    for (size_t i = 0; i < old.size(); i++){
+        size_t index = (i / oldColumns) * columns + i % oldColumns;
+        if (old[i].data && int(i % oldColumns) < columns){
+            if (index >= tiles.size()){
+                tiles.resize(index + 1);
+            }
+            tiles[index] = std::move(old[i]);
+        } else {
+            old[i].tile.reset();
+        }
+    }
+    updateScrollBar();
+    viewport()->update();
+}
+
+/**
+ * Sets function creating tiles, existing tiles are recreated
+ * @param tileFactory Tile factory
+ */
+void DashboardCanvas::setTileFactory(TileFactory tileFactory)
+{
+    factory = std::move(tileFactory);
+    for (auto& slot: tiles){
+        slot.tile.reset();
+        instantiate(slot);
+    }
+    viewport()->update();
+}
+
+/**
+ * Places tile configuration into grid replacing previous tile and creates the tile
+ * @param data Tile configuration
+ */
+void DashboardCanvas::setTile(const DashboardItemData& data)
+{
+    if (data.column >= uint(columns)){
+        return;
+    }
+    size_t index = size_t(data.row) * columns + data.column;
+    if (index >= tiles.size()){
+        tiles.resize(index + 1);
+    }
+    tiles[index].tile.reset();
+    tiles[index].data = std::make_unique<DashboardItemData>(data);
+    instantiate(tiles[index]);
+    updateScrollBar();
+    viewport()->update();
+}
+
+/**
+ * Removes tile from grid
+ * @param row Row of tile
+ * @param column Column of tile
+ */
+void DashboardCanvas::removeTile(uint row, uint column)
+{
+    size_t index = size_t(row) * columns + column;
+    if (column >= uint(columns) || index >= tiles.size()){
+        return;
+    }
+    tiles[index].tile.reset();
+    tiles[index].data.reset();
+    while (!tiles.empty() && !tiles.back().data){
+        tiles.pop_back();
+    }
+    updateScrollBar();
+    viewport()->update();
+}
+
+/** Removes all tiles */
+void DashboardCanvas::clear()
+{
+    tiles.clear();
+    updateScrollBar();
+    viewport()->update();
+}
+
+/**
+ * Creates tile of slot if it does not exist yet, the tile starts watching its topics
+ * @param slot Grid cell with tile configuration
+ */
+void DashboardCanvas::instantiate(Slot& slot)
+{
+    if (!slot.tile && slot.data && factory){
+        slot.tile = factory(*slot.data);
+    }
+}
+
+/**
+ * Queues tile for refresh in next frame, called from ingestion thread
+ * @param tile Updated tile
+ */
+void DashboardCanvas::markDirty(DashboardTile* tile)
+{
+    std::lock_guard<std::mutex> lock(dirtyMutex);
+    dirtyTiles.push_back(tile);
+}
+
+/**
+ * Drops tile from refresh queue, called by destructor of the tile
+ * @param tile Deleted tile
+ */
+void DashboardCanvas::forget(DashboardTile* tile)
+{
+    std::lock_guard<std::mutex> lock(dirtyMutex);
+    dirtyTiles.erase(std::remove(dirtyTiles.begin(), dirtyTiles.end(), tile), dirtyTiles.end());
+}
+
+/**
+ * Refreshes and repaints updated tiles that are visible, others stay dirty until they are painted
+ */
+void DashboardCanvas::refreshDirty()
+{
+    std::vector<DashboardTile*> dirty;
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex);
+        if (dirtyTiles.empty()){
+            return;
+        }
+        dirty.swap(dirtyTiles);
+    }
+    std::sort(dirty.begin(), dirty.end());
+    QRect visible = viewport()->rect();
+    for (size_t i = 0; i < tiles.size(); i++){
+        DashboardTile* tile = tiles[i].tile.get();
+        if (tile == nullptr || !std::binary_search(dirty.begin(), dirty.end(), tile)){
+            continue;
+        }
+        QRect rect = tileRect(i);
+        if (rect.intersects(visible)){
+            tile->dirty = false;
+            tile->refresh();
+            viewport()->update(rect);
+        }
+    }
+}
+
+/** @return Number of rows containing tiles */
+int DashboardCanvas::rowCount() const
+{
+    return int((tiles.size() + columns - 1) / columns);
+}
+
+/** @return Width of one tile in pixels */
+int DashboardCanvas::tileWidth() const
+{
+    return std::max(1, (viewport()->width() - SPACING) / columns - SPACING);
+}
+
+/**
+ * Position of tile in viewport coordinates
+ * @param index Index of tile
+ */
+QRect DashboardCanvas::tileRect(size_t index) const
+{
+    int row = int(index / columns);
+    int column = int(index % columns);
+    int width = tileWidth();
+    return {SPACING + column * (width + SPACING),
+            SPACING + row * (TILE_HEIGHT + SPACING) - verticalScrollBar()->value(),
+            width, TILE_HEIGHT};
+}
+
+/**
+ * Area of tile below its name
+ * @param tile Tile position
+ */
+QRect DashboardCanvas::contentRect(const QRect& tile)
+{
+    return tile.adjusted(8, TITLE_HEIGHT + 4, -8, -8);
+}
+
+/**
+ * Paints tiles of visible rows
+ */
+void DashboardCanvas::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    painter.setRenderHint(QPainter::Antialiasing);
+    int offset = verticalScrollBar()->value();
+    int firstRow = std::max(0, (event->rect().top() + offset - SPACING) / (TILE_HEIGHT + SPACING));
+    int lastRow = std::min(rowCount() - 1, (event->rect().bottom() + offset) / (TILE_HEIGHT + SPACING));
+    for (int row = firstRow; row <= lastRow; row++){
+        for (int column = 0; column < columns; column++){
+            size_t index = size_t(row) * columns + column;
+            if (index >= tiles.size() || !tiles[index].data){
+                continue;
+            }
+            QRect rect = tileRect(index);
+            if (!rect.intersects(event->rect())){
+                continue;
+            }
+            DashboardTile* tile = tiles[index].tile.get();
+            // Tile scrolled into view applies updates received while hidden
+            if (tile != nullptr && tile->dirty.exchange(false)){
+                tile->refresh();
+            }
+            painter.save();
+            painter.setPen(palette().color(QPalette::Mid));
+            painter.setBrush(palette().color(QPalette::Base));
+            painter.drawRoundedRect(rect, 6, 6);
+            painter.setPen(palette().color(QPalette::Text));
+            painter.setBrush(Qt::NoBrush);
+            QRect title(rect.left() + 8, rect.top() + 4, rect.width() - 16, TITLE_HEIGHT);
+            QFont font = painter.font();
+            font.setBold(true);
+            painter.setFont(font);
+            painter.drawText(title, Qt::AlignLeft | Qt::AlignVCenter,
+                             painter.fontMetrics().elidedText(tiles[index].data->name.c_str(),
+                                                              Qt::ElideRight, title.width()));
+            font.setBold(false);
+            painter.setFont(font);
+            QRect content = contentRect(rect);
+            painter.setClipRect(content);
+            if (tile != nullptr){
+                tile->paint(painter, content);
+            }
+            painter.restore();
+        }
+    }
+}
+
+/**
+ * Passes click to tile under cursor
+ */
+void DashboardCanvas::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton){
+        return;
+    }
+    int width = tileWidth();
+    int y = event->pos().y() + verticalScrollBar()->value() - SPACING;
+    int x = event->pos().x() - SPACING;
+    if (x < 0 || y < 0){
+        return;
+    }
+    size_t index = size_t(y / (TILE_HEIGHT + SPACING)) * columns + std::min(columns - 1, x / (width + SPACING));
+    if (index >= tiles.size() || tiles[index].tile == nullptr){
+        return;
+    }
+    QRect content = contentRect(tileRect(index));
+    if (content.contains(event->pos())){
+        tiles[index].tile->click(event->pos(), content);
+        viewport()->update(tileRect(index));
+    }
+}
+
+/**
+ * Recomputes tile width and scroll range
+ */
+void DashboardCanvas::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBar();
+}
+
+/**
+ * Sets scroll range to height of all rows
+ */
+void DashboardCanvas::updateScrollBar()
+{
+    int height = SPACING + rowCount() * (TILE_HEIGHT + SPACING);
+    verticalScrollBar()->setPageStep(viewport()->height());
+    verticalScrollBar()->setRange(0, std::max(0, height - viewport()->height()));
+}
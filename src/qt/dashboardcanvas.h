@@ -0,0 +1,78 @@
+/** @file dashboardcanvas.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#ifndef DASHBOARDCANVAS_H
+#define DASHBOARDCANVAS_H
+
+#include <QAbstractScrollArea>
+#include <QTimer>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "dashboardtile.h"
+
+/**
+ * Scrollable grid of dashboard tiles painted directly, without a widget per tile.
+ * Every tile watches its topics from the moment it is placed, updates are decoded by refresh only when the
+ * tile is visible. Only tiles in visible rows are painted and updated tiles are repainted at most once per frame.
+ */
+class DashboardCanvas : public QAbstractScrollArea
+{
+    Q_OBJECT
+    /** Height of one tile in pixels */
+    static const int TILE_HEIGHT = 220;
+    /** Space between tiles in pixels */
+    static const int SPACING = 6;
+    /** Height of tile name line in pixels */
+    static const int TITLE_HEIGHT = 24;
+
+public:
+    /** Creates tile from its configuration */
+    using TileFactory = std::function<std::unique_ptr<DashboardTile>(const DashboardItemData& data)>;
+
+private:
+    /** Grid cell, tile exists whenever configuration and factory are set */
+    struct Slot{
+        std::unique_ptr<DashboardItemData> data;
+        std::unique_ptr<DashboardTile> tile;
+    };
+
+    int columns = 4;
+    /** Cells indexed by row * columns + column */
+    std::vector<Slot> tiles;
+    TileFactory factory;
+    QTimer frameTimer;
+
+    std::mutex dirtyMutex;
+    std::vector<DashboardTile*> dirtyTiles;
+
+public:
+    explicit DashboardCanvas(QWidget *parent = nullptr);
+    ~DashboardCanvas() override;
+    void setColumnCount(int count);
+    void setTileFactory(TileFactory tileFactory);
+    void setTile(const DashboardItemData& data);
+    void removeTile(uint row, uint column);
+    void clear();
+    void markDirty(DashboardTile* tile);
+    void forget(DashboardTile* tile);
+
+public slots:
+    void refreshDirty();
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+
+private:
+    int rowCount() const;
+    int tileWidth() const;
+    QRect tileRect(size_t index) const;
+    static QRect contentRect(const QRect& tile);
+    void instantiate(Slot& slot);
+    void updateScrollBar();
+};
+
+#endif // DASHBOARDCANVAS_H
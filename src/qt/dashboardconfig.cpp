@@ -0,0 +1,227 @@
+/** @file dashboardconfig.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#include <iostream>
+#include <utility>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include "dashboardconfig.h"
+
+/** Text fields of DashboardItemData with their names in file */
+static const std::pair<const char*, std::string DashboardItemData::*> TEXT_FIELDS[] = {
+        {"name", &DashboardItemData::name},
+        {"type", &DashboardItemData::type},
+        {"onOffType", &DashboardItemData::onOffType},
+        {"stateTopic", &DashboardItemData::stateTopic},
+        {"offStateMessage", &DashboardItemData::offStateMessage},
+        {"onStateMessage", &DashboardItemData::onStateMessage},
+        {"controlTopic", &DashboardItemData::controlTopic},
+        {"turnOffCommand", &DashboardItemData::turnOffCommand},
+        {"turnOnCommand", &DashboardItemData::turnOnCommand},
+        {"matchMessage", &DashboardItemData::matchMessage},
+        {"fieldPath", &DashboardItemData::fieldPath},
+};
+
+/**
+ * Constructor
+ * @param path Path of configuration file
+ */
+DashboardConfig::DashboardConfig(QString path) : path(std::move(path)) {}
+
+/** @return True if configuration file exists */
+bool DashboardConfig::exists() const
+{
+    return QFile::exists(path);
+}
+
+/**
+ * Reads configuration file in one pass
+ * @return All tiles ordered by row and column
+ */
+std::vector<DashboardItemData> DashboardConfig::load()
+{
+    items.clear();
+    records = 0;
+    file.close();
+    QFile input(path);
+    if (input.open(QIODevice::ReadOnly)){
+        QByteArray header = input.readLine();
+        int version = QJsonDocument::fromJson(header).object().value("version").toInt();
+        if (version != VERSION){
+            std::cerr << "Unsupported dashboard configuration version " << version << std::endl;
+            return {};
+        }
+        while (!input.atEnd()){
+            // Unreadable line, e.g. unfinished write, is skipped
+            QJsonObject record = QJsonDocument::fromJson(input.readLine()).object();
+            records++;
+            QJsonArray position = record.contains("set") ? record.value("set").toArray() : record.value("remove").toArray();
+            if (position.size() != 2){
+                continue;
+            }
+            auto key = std::make_pair(uint(position[0].toInt()), uint(position[1].toInt()));
+            if (record.contains("remove")){
+                items.erase(key);
+                continue;
+            }
+            auto it = items.find(key);
+            if (it == items.end()){
+                it = items.emplace(key, DashboardItemData()).first;
+                it->second.row = key.first;
+                it->second.column = key.second;
+                it->second.controllable = false;
+            }
+            apply(record, it->second);
+        }
+    }
+    if (records > 2 * items.size() + 64){
+        compact();
+    }
+    std::vector<DashboardItemData> result;
+    result.reserve(items.size());
+    for (const auto& it: items){
+        result.push_back(it.second);
+    }
+    return result;
+}
+
+/**
+ * Replaces configuration with tiles of dashboard settings used by older versions
+ * @param settings Settings with group "row-column" for every tile
+ */
+void DashboardConfig::migrate(QSettings& settings)
+{
+    items.clear();
+    for (const auto& group: settings.childGroups()){
+        auto position = group.split('-');
+        if (position.size() != 2){
+            continue;
+        }
+        DashboardItemData data;
+        data.row = position[0].toUInt();
+        data.column = position[1].toUInt();
+        settings.beginGroup(group);
+        for (const auto& field: TEXT_FIELDS){
+            data.*field.second = settings.value(field.first).toString().toStdString();
+        }
+        data.controllable = settings.value("controllable").toBool();
+        settings.endGroup();
+        items[std::make_pair(data.row, data.column)] = data;
+    }
+    compact();
+}
+
+/**
+ * Stores tile, only fields changed since last save are appended to file
+ * @param data Tile configuration
+ */
+void DashboardConfig::save(const DashboardItemData& data)
+{
+    auto key = std::make_pair(data.row, data.column);
+    auto it = items.find(key);
+    QJsonObject record = diff(data, it == items.end() ? nullptr : &it->second);
+    items[key] = data;
+    if (record.size() > 1){
+        append(record);
+    }
+}
+
+/**
+ * Removes tile from configuration
+ * @param row Row of tile
+ * @param column Column of tile
+ */
+void DashboardConfig::remove(uint row, uint column)
+{
+    if (items.erase(std::make_pair(row, column)) == 0){
+        return;
+    }
+    QJsonObject record;
+    record.insert("remove", QJsonArray{int(row), int(column)});
+    append(record);
+}
+
+/**
+ * Appends record to configuration file, file is compacted when it has too many old records
+ * @param record Record to append
+ */
+void DashboardConfig::append(const QJsonObject& record)
+{
+    if (!exists() || records > 2 * items.size() + 64){
+        compact();
+        return;
+    }
+    if (!file.isOpen()){
+        file.setFileName(path);
+        if (!file.open(QIODevice::Append)){
+            std::cerr << "Unable to write dashboard configuration " << path.toStdString() << std::endl;
+            return;
+        }
+    }
+    file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    file.flush();
+    records++;
+}
+
+/**
+ * Atomically rewrites configuration file with one record per tile
+ */
+void DashboardConfig::compact()
+{
+    file.close();
+    QSaveFile output(path);
+    if (!output.open(QIODevice::WriteOnly)){
+        std::cerr << "Unable to write dashboard configuration " << path.toStdString() << std::endl;
+        return;
+    }
+    QJsonObject header;
+    header.insert("version", VERSION);
+    output.write(QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n');
+    for (const auto& it: items){
+        output.write(QJsonDocument(diff(it.second, nullptr)).toJson(QJsonDocument::Compact) + '\n');
+    }
+    if (output.commit()){
+        records = items.size();
+    }
+}
+
+/**
+ * Creates record of changed fields
+ * @param data New tile configuration
+ * @param old Previous configuration or nullptr for new tile
+ * @return Record with position and every field that differs, empty fields of new tile are omitted
+ */
+QJsonObject DashboardConfig::diff(const DashboardItemData& data, const DashboardItemData* old)
+{
+    QJsonObject record;
+    record.insert("set", QJsonArray{int(data.row), int(data.column)});
+    for (const auto& field: TEXT_FIELDS){
+        const std::string& value = data.*field.second;
+        if (old != nullptr ? value != old->*field.second : !value.empty()){
+            record.insert(field.first, QString::fromStdString(value));
+        }
+    }
+    if (old != nullptr ? data.controllable != old->controllable : data.controllable){
+        record.insert("controllable", data.controllable);
+    }
+    return record;
+}
+
+/**
+ * Applies fields of record to tile
+ * @param record Record read from file
+ * @param data Tile configuration
+ */
+void DashboardConfig::apply(const QJsonObject& record, DashboardItemData& data)
+{
+    for (const auto& field: TEXT_FIELDS){
+        if (record.contains(field.first)){
+            data.*field.second = record.value(field.first).toString().toStdString();
+        }
+    }
+    if (record.contains("controllable")){
+        data.controllable = record.value("controllable").toBool();
+    }
+}
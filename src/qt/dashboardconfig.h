@@ -0,0 +1,45 @@
+/** @file dashboardconfig.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Dashboard configuration file. First line is a header {"version":1}, every other line is one JSON record:
+ *  {"set":[row,column], field: value, ...} changes listed fields of a tile, {"remove":[row,column]} deletes it.
+ *  Records are only appended, the file is rewritten with one record per tile when it contains too many old records.
+ */
+#ifndef DASHBOARDCONFIG_H
+#define DASHBOARDCONFIG_H
+
+#include <QFile>
+#include <QJsonObject>
+#include <QSettings>
+#include <map>
+#include <vector>
+#include "dashboarditemdata.h"
+
+class DashboardConfig
+{
+public:
+    /** Current version of file format */
+    static const int VERSION = 1;
+
+    explicit DashboardConfig(QString path);
+    bool exists() const;
+    std::vector<DashboardItemData> load();
+    void migrate(QSettings& settings);
+    void save(const DashboardItemData& data);
+    void remove(uint row, uint column);
+
+private:
+    QString path;
+    std::map<std::pair<uint, uint>, DashboardItemData> items;
+    /** Number of records in file */
+    size_t records = 0;
+    QFile file;
+
+    void append(const QJsonObject& record);
+    void compact();
+    static QJsonObject diff(const DashboardItemData& data, const DashboardItemData* old);
+    static void apply(const QJsonObject& record, DashboardItemData& data);
+};
+
+#endif // DASHBOARDCONFIG_H
@@ -0,0 +1,34 @@
+/** @file dashboarditemdata.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#ifndef DASHBOARDITEMDATA_H
+#define DASHBOARDITEMDATA_H
+
+#include <QMetaType>
+#include <string>
+
+/**
+ * Configuration of one dashboard tile
+ */
+struct DashboardItemData{
+    uint row;
+    uint column;
+    std::string name;
+    std::string type;
+
+    std::string onOffType;
+    std::string stateTopic;
+    std::string offStateMessage;
+    std::string onStateMessage;
+    bool controllable;
+    std::string controlTopic;
+    std::string turnOffCommand;
+    std::string turnOnCommand;
+    std::string matchMessage;  ///< Payload counted by Count matching tile
+    std::string fieldPath;     ///< Shown field of JSON payload (e.g. $.temp), whole payload if empty
+};
+
+Q_DECLARE_METATYPE(DashboardItemData*)
+
+#endif // DASHBOARDITEMDATA_H
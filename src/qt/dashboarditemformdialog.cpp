@@ -8,6 +8,7 @@
 #include "dashboarditemformdialog.h"
 #include "ui_dashboarditemformdialog.h"
 #include "mainwindow.h"
+#include "Aggregation.h"
 
 
 DashboardItemFormDialog::DashboardItemFormDialog(QWidget *parent, std::shared_ptr<QStandardItemModel> dashboardModel, QModelIndex index):
@@ -31,6 +32,8 @@ DashboardItemFormDialog::DashboardItemFormDialog(QWidget *parent, std::shared_pt
         ui->onoff_control_topic->setText(dashboardItemData->controlTopic.data());
         ui->onoff_on_command->setText(dashboardItemData->turnOnCommand.data());
         ui->onoff_turnoff_command->setText(dashboardItemData->turnOffCommand.data());
+        ui->aggregate_match->setText(dashboardItemData->matchMessage.data());
+        ui->field_path->setText(dashboardItemData->fieldPath.data());
     }
 }
 
@@ -47,6 +50,14 @@ void DashboardItemFormDialog::nextButton() {
         if (ui->comboBox_type->currentText() == "On/Off"){
             ui->formPageWidget->setCurrentWidget(ui->onOff);
         } else {
+            Aggregation::Kind kind;
+            bool aggregate = Aggregation::kind_from_name(ui->comboBox_type->currentText().toStdString(), kind);
+            ui->label_3->setText(aggregate ? "Subscribe topic filter (+ and # wildcards)" : "Subscribe topic");
+            ui->label_match->setVisible(aggregate && kind == Aggregation::COUNT_MATCHING);
+            ui->aggregate_match->setVisible(aggregate && kind == Aggregation::COUNT_MATCHING);
+            bool send = ui->comboBox_type->currentText() == "MultiLine Send";
+            ui->label_field->setVisible(!send);
+            ui->field_path->setVisible(!send);
             ui->formPageWidget->setCurrentWidget(ui->topic_only);
         }
         ui->pushButton_next->setText("Done");
@@ -59,6 +70,10 @@ void DashboardItemFormDialog::nextButton() {
         dashboardItemData->type = ui->comboBox_type->currentText().toStdString();
         if (ui->formPageWidget->currentWidget() == ui->topic_only){
             dashboardItemData->stateTopic = ui->subscribe_topic->text().toStdString();
+            dashboardItemData->matchMessage = ui->aggregate_match->text().toStdString();
+            if (ui->comboBox_type->currentText() != "MultiLine Send"){
+                dashboardItemData->fieldPath = ui->field_path->text().trimmed().toStdString();
+            }
         } else if (ui->formPageWidget->currentWidget() == ui->onOff){
             dashboardItemData->onOffType = ui->onoff_type_comboBox->currentText().toStdString();
             dashboardItemData->stateTopic = ui->onoff_state_topic->text().toStdString();
@@ -0,0 +1,419 @@
+/** @file dashboardtile.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#include <iostream>
+#include <utility>
+#include <QInputDialog>
+#include "dashboardtile.h"
+#include "dashboardcanvas.h"
+#include "jsonpayload.h"
+
+/**
+ * Constructor, watching of topics starts with start
+ * @param data Tile configuration
+ * @param client Client providing topic store
+ * @param canvas Canvas painting the tile
+ */
+DashboardTile::DashboardTile(DashboardItemData data, std::shared_ptr<Mqttclient> client, DashboardCanvas* canvas) :
+    data(std::move(data)), client(std::move(client)), canvas(canvas) {}
+
+/** Destructor, stops watching and removes the tile from refresh queue of canvas */
+DashboardTile::~DashboardTile()
+{
+    stop();
+    canvas->forget(this);
+}
+
+/**
+ * Creates tile of configured type and starts watching its topics
+ * @param data Tile configuration
+ * @param client Client providing topic store
+ * @param canvas Canvas painting the tile
+ * @return New tile
+ */
+std::unique_ptr<DashboardTile> DashboardTile::create(const DashboardItemData& data, std::shared_ptr<Mqttclient> client,
+                                                     DashboardCanvas* canvas)
+{
+    std::unique_ptr<DashboardTile> tile;
+    Aggregation::Kind kind;
+    if (data.type == "On/Off"){
+        tile = std::make_unique<OnOffTile>(data, std::move(client), canvas);
+    } else if (data.type == "MultiLine Text"){
+        tile = std::make_unique<MultilineTile>(data, std::move(client), canvas);
+    } else if (data.type == "MultiLine Send"){
+        tile = std::make_unique<SendTile>(data, std::move(client), canvas);
+    } else if (Aggregation::kind_from_name(data.type, kind)){
+        tile = std::make_unique<AggregateTile>(data, std::move(client), canvas, kind);
+    } else {
+        if (data.type != "Centered Oneline"){
+            std::cout << data.type << std::endl;
+        }
+        tile = std::make_unique<CenteredTile>(data, std::move(client), canvas);
+    }
+    tile->start();
+    return tile;
+}
+
+/**
+ * Starts watching state topic, latest known value is shown immediately
+ */
+void DashboardTile::start()
+{
+    if (data.stateTopic.empty()){
+        return;
+    }
+    watchId = client->topics.watch(data.stateTopic, [this](const mqtt::binary_ref& payload,
+                                                            std::chrono::time_point<std::chrono::system_clock>){
+        received(payload);
+    });
+    mqtt::binary_ref payload;
+    std::chrono::time_point<std::chrono::system_clock> received_time;
+    if (client->topics.latest(data.stateTopic, payload, received_time)){
+        received(payload);
+    }
+}
+
+/**
+ * Stops watching topics, after return no update of the tile is running
+ */
+void DashboardTile::stop()
+{
+    if (watchId != 0){
+        client->unwatch(watchId);
+        watchId = 0;
+    }
+}
+
+/**
+ * Stores received payload until refresh, called from ingestion thread
+ * @param payload Latest payload of state topic
+ */
+void DashboardTile::received(const mqtt::binary_ref& payload)
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending = payload;
+    }
+    notify();
+}
+
+/**
+ * Queues the tile for refresh unless it is queued already
+ */
+void DashboardTile::notify()
+{
+    if (!dirty.exchange(true)){
+        canvas->markDirty(this);
+    }
+}
+
+/**
+ * @return Payload received since previous call, empty if none
+ */
+mqtt::binary_ref DashboardTile::takePending()
+{
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    mqtt::binary_ref payload;
+    std::swap(payload, pending);
+    return payload;
+}
+
+/**
+ * Converts payload to text
+ * @param payload Message payload
+ * @return Payload decoded as UTF-8
+ */
+QString DashboardTile::text(const mqtt::binary_ref& payload)
+{
+    if (payload.empty()){
+        return QString();
+    }
+    return QString::fromUtf8(payload.data(), payload.length());
+}
+
+/**
+ * Extracts configured field from JSON payload, the parsed document is shared by all tiles and
+ * the topic history showing the same payload
+ * @param payload Message payload
+ * @param value Output text of field
+ * @return False if no field is configured, value is then not set
+ */
+bool DashboardTile::fieldText(const mqtt::binary_ref& payload, QString& value) const
+{
+    if (data.fieldPath.empty()){
+        return false;
+    }
+    auto document = sharedJsonPayload(payload);
+    QJsonValue field;
+    if (document && jsonField(*document, data.fieldPath, field)){
+        value = jsonText(field);
+    } else {
+        value = QString("No %1").arg(data.fieldPath.c_str());
+    }
+    return true;
+}
+
+/**
+ * Decodes latest payload as image or text
+ */
+void CenteredTile::refresh()
+{
+    auto payload = takePending();
+    if (!payload){
+        return;
+    }
+    scaled = QPixmap();
+    if (fieldText(payload, value)){
+        image = QPixmap();
+        return;
+    }
+    uint len = payload.length()*sizeof(uchar);
+    if (image.loadFromData((uchar*)payload.data(), len)){
+        value.clear();
+    } else {
+        image = QPixmap();
+        value = text(payload);
+    }
+}
+
+/**
+ * Paints latest value, images are scaled once per tile size
+ */
+void CenteredTile::paint(QPainter& painter, const QRect& rect)
+{
+    if (!image.isNull()){
+        if (scaled.isNull() || (scaled.width() != rect.width() && scaled.height() != rect.height())){
+            scaled = image.scaled(rect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        QRect target(QPoint(0, 0), scaled.size());
+        target.moveCenter(rect.center());
+        painter.drawPixmap(target, scaled);
+    } else {
+        QFont font = painter.font();
+        font.setPointSizeF(font.pointSizeF() * 1.6);
+        painter.setFont(font);
+        painter.drawText(rect, Qt::AlignCenter | Qt::TextWordWrap, value);
+    }
+}
+
+/** Destructor, stops watching before received lines are destroyed */
+MultilineTile::~MultilineTile()
+{
+    stop();
+}
+
+/**
+ * Stores every received payload until refresh, called from ingestion thread
+ * @param payload Received payload of state topic
+ */
+void MultilineTile::received(const mqtt::binary_ref& payload)
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        if (received_lines.size() >= MAX_LINES){
+            received_lines.erase(received_lines.begin());
+        }
+        received_lines.push_back(payload);
+    }
+    notify();
+}
+
+/**
+ * Appends payloads received since previous refresh
+ */
+void MultilineTile::refresh()
+{
+    std::vector<mqtt::binary_ref> payloads;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        payloads.swap(received_lines);
+    }
+    for (const auto& payload: payloads){
+        QString line;
+        if (!fieldText(payload, line)){
+            line = text(payload);
+        }
+        lines.push_back(line);
+        if (lines.size() > MAX_LINES){
+            lines.pop_front();
+        }
+    }
+}
+
+/**
+ * Paints as many latest lines as fit, newest at the bottom
+ */
+void MultilineTile::paint(QPainter& painter, const QRect& rect)
+{
+    int height = painter.fontMetrics().height();
+    int y = rect.bottom() - height;
+    for (auto it = lines.rbegin(); it != lines.rend() && y >= rect.top(); ++it){
+        QString line = painter.fontMetrics().elidedText(*it, Qt::ElideRight, rect.width());
+        painter.drawText(QRect(rect.left(), y, rect.width(), height), Qt::AlignLeft | Qt::AlignVCenter, line);
+        y -= height;
+    }
+}
+
+/**
+ * Converts latest payload to user friendly state
+ */
+void OnOffTile::refresh()
+{
+    auto payload = takePending();
+    if (!payload){
+        return;
+    }
+    const std::string& message = payload;
+    if (message == data.onStateMessage){
+        if (data.onOffType == "Light"){
+            state = "Light on";
+        } else if (data.onOffType == "Door"){
+            state = "Door open";
+        } else {
+            state = "Turned on";
+        }
+    } else if (message == data.offStateMessage) {
+        if (data.onOffType == "Light") {
+            state = "Light off";
+        } else if (data.onOffType == "Door") {
+            state = "Door closed";
+        } else {
+            state = "Turned off";
+        }
+    } else {
+        // Unknown message
+        state = "Unrecognized state";
+    }
+}
+
+/**
+ * Area of control button
+ * @param rect Tile content area
+ * @param index 0 for on button, 1 for off button
+ */
+QRect OnOffTile::buttonRect(const QRect& rect, int index)
+{
+    int width = rect.width() / 2 - 4;
+    return {rect.left() + index * (width + 8), rect.bottom() - 30, width, 30};
+}
+
+/**
+ * Paints state and control buttons
+ */
+void OnOffTile::paint(QPainter& painter, const QRect& rect)
+{
+    QRect stateRect = rect;
+    if (data.controllable){
+        stateRect.setBottom(rect.bottom() - 36);
+        for (int i = 0; i < 2; i++){
+            QRect button = buttonRect(rect, i);
+            painter.drawRoundedRect(button, 4, 4);
+            painter.drawText(button, Qt::AlignCenter, i == 0 ? "On" : "Off");
+        }
+    }
+    QFont font = painter.font();
+    font.setPointSizeF(font.pointSizeF() * 1.6);
+    painter.setFont(font);
+    painter.drawText(stateRect, Qt::AlignCenter, state);
+}
+
+/**
+ * Sends on/off command when a button is clicked
+ */
+void OnOffTile::click(const QPoint& pos, const QRect& rect)
+{
+    if (!data.controllable){
+        return;
+    }
+    if (buttonRect(rect, 0).contains(pos)){
+        client->send_message(data.controlTopic, data.turnOnCommand);
+    } else if (buttonRect(rect, 1).contains(pos)){
+        client->send_message(data.controlTopic, data.turnOffCommand);
+    }
+}
+
+/**
+ * Paints target topic of the tile
+ */
+void SendTile::paint(QPainter& painter, const QRect& rect)
+{
+    painter.drawText(rect, Qt::AlignCenter | Qt::TextWordWrap,
+                     QString("Click to send message to\n%1").arg(data.stateTopic.c_str()));
+}
+
+/**
+ * Asks for message text and sends it
+ */
+void SendTile::click(const QPoint& pos, const QRect& rect)
+{
+    bool ok;
+    QString message = QInputDialog::getMultiLineText(canvas, data.name.c_str(), "Message", QString(), &ok);
+    if (ok && !data.stateTopic.empty()){
+        client->send_message(data.stateTopic, message.toStdString());
+    }
+}
+
+/**
+ * Constructor
+ * @param kind Computed aggregation
+ */
+AggregateTile::AggregateTile(DashboardItemData data, std::shared_ptr<Mqttclient> client, DashboardCanvas* canvas,
+                             Aggregation::Kind kind) :
+    DashboardTile(std::move(data), std::move(client), canvas), aggregation(kind, this->data.matchMessage)
+{
+    value = "No data";
+}
+
+/** Destructor, stops watching before aggregation is destroyed */
+AggregateTile::~AggregateTile()
+{
+    stop();
+}
+
+/**
+ * Starts watching all topics matching state topic filter, known topics are aggregated immediately
+ */
+void AggregateTile::start()
+{
+    if (data.stateTopic.empty()){
+        return;
+    }
+    // Only a changed value queues a refresh
+    watchId = client->watch_filter(data.stateTopic, [this](const std::string& topic,
+                                                           const mqtt::binary_ref& payload){
+        static const std::string empty;
+        QString field;
+        if (fieldText(payload, field)){
+            if (aggregation.update(topic, field.toStdString())){
+                notify();
+            }
+        } else if (aggregation.update(topic, payload.empty() ? empty : payload)){
+            notify();
+        }
+    });
+}
+
+/**
+ * Formats current value of aggregation
+ */
+void AggregateTile::refresh()
+{
+    double result;
+    if (aggregation.value(result)){
+        value = QString("%1\n(%2 topics)").arg(result, 0, 'g', 6).arg(aggregation.topics());
+    } else {
+        value = "No data";
+    }
+}
+
+/**
+ * Paints current value of aggregation
+ */
+void AggregateTile::paint(QPainter& painter, const QRect& rect)
+{
+    QFont font = painter.font();
+    font.setPointSizeF(font.pointSizeF() * 1.6);
+    painter.setFont(font);
+    painter.drawText(rect, Qt::AlignCenter, value);
+}
@@ -0,0 +1,129 @@
+/** @file dashboardtile.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#ifndef DASHBOARDTILE_H
+#define DASHBOARDTILE_H
+
+#include <QPainter>
+#include <QPixmap>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include "Mqttclient.h"
+#include "Aggregation.h"
+#include "dashboarditemdata.h"
+
+class DashboardCanvas;
+
+/**
+ * Lightweight dashboard tile painted by DashboardCanvas. Only the class of the configured tile type is created.
+ * Updates of watched topics arrive in the ingestion thread, they are stored as pending and applied
+ * by refresh in the GUI thread, at most once per canvas frame. Derived tiles whose watch uses their own
+ * members call stop in their destructor.
+ */
+class DashboardTile{
+public:
+    DashboardTile(DashboardItemData data, std::shared_ptr<Mqttclient> client, DashboardCanvas* canvas);
+    virtual ~DashboardTile();
+    static std::unique_ptr<DashboardTile> create(const DashboardItemData& data, std::shared_ptr<Mqttclient> client,
+                                                 DashboardCanvas* canvas);
+
+    const DashboardItemData& itemData() const { return data; }
+    virtual void start();
+    void stop();
+    /** Applies updates received since previous refresh, called in GUI thread */
+    virtual void refresh() {}
+    /**
+     * Paints tile content
+     * @param painter Painter of canvas
+     * @param rect Content area below tile name
+     */
+    virtual void paint(QPainter& painter, const QRect& rect) = 0;
+    /**
+     * Handles mouse click into tile content
+     * @param pos Position of click
+     * @param rect Content area below tile name
+     */
+    virtual void click(const QPoint& pos, const QRect& rect) {}
+
+    /** Set while the tile waits for refresh in canvas */
+    std::atomic<bool> dirty{false};
+
+protected:
+    DashboardItemData data;
+    std::shared_ptr<Mqttclient> client;
+    DashboardCanvas* canvas;
+    int watchId = 0;
+
+    std::mutex pendingMutex;
+    mqtt::binary_ref pending;
+
+    virtual void received(const mqtt::binary_ref& payload);
+    void notify();
+    mqtt::binary_ref takePending();
+    static QString text(const mqtt::binary_ref& payload);
+    bool fieldText(const mqtt::binary_ref& payload, QString& value) const;
+};
+
+/** Tile showing latest payload as a line of text or an image */
+class CenteredTile : public DashboardTile{
+    QString value;
+    QPixmap image;
+    QPixmap scaled;
+public:
+    using DashboardTile::DashboardTile;
+    void refresh() override;
+    void paint(QPainter& painter, const QRect& rect) override;
+};
+
+/** Tile showing history of payloads */
+class MultilineTile : public DashboardTile{
+    /** Number of kept lines */
+    static const size_t MAX_LINES = 200;
+    std::vector<mqtt::binary_ref> received_lines;
+    std::deque<QString> lines;
+public:
+    using DashboardTile::DashboardTile;
+    ~MultilineTile() override;
+    void refresh() override;
+    void paint(QPainter& painter, const QRect& rect) override;
+protected:
+    void received(const mqtt::binary_ref& payload) override;
+};
+
+/** Tile showing on/off state with optional control buttons */
+class OnOffTile : public DashboardTile{
+    QString state;
+public:
+    using DashboardTile::DashboardTile;
+    void refresh() override;
+    void paint(QPainter& painter, const QRect& rect) override;
+    void click(const QPoint& pos, const QRect& rect) override;
+private:
+    static QRect buttonRect(const QRect& rect, int index);
+};
+
+/** Tile publishing entered text to its topic */
+class SendTile : public DashboardTile{
+public:
+    using DashboardTile::DashboardTile;
+    void start() override {}
+    void paint(QPainter& painter, const QRect& rect) override;
+    void click(const QPoint& pos, const QRect& rect) override;
+};
+
+/** Tile showing aggregation over topics matching a wildcard filter */
+class AggregateTile : public DashboardTile{
+    Aggregation aggregation;
+    QString value;
+public:
+    AggregateTile(DashboardItemData data, std::shared_ptr<Mqttclient> client, DashboardCanvas* canvas,
+                  Aggregation::Kind kind);
+    ~AggregateTile() override;
+    void start() override;
+    void refresh() override;
+    void paint(QPainter& painter, const QRect& rect) override;
+};
+
+#endif // DASHBOARDTILE_H
@@ -0,0 +1,209 @@
+/** @file jsonpayload.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+#include "jsonpayload.h"
+#include <QJsonArray>
+#include <QJsonObject>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+/** Parsed payload, document is empty if the payload is not JSON */
+struct ParsedPayload{
+    std::weak_ptr<const std::string> payload;
+    std::shared_ptr<const QJsonDocument> document;
+};
+
+std::mutex parsedMutex;
+/** Parsed payloads by address of payload buffer */
+std::unordered_map<const std::string*, ParsedPayload> parsedPayloads;
+/** Size of parsedPayloads at which entries of freed payloads are removed */
+size_t parsedPurgeSize = 1024;
+
+}
+
+/**
+ * Parses payload as JSON object or array
+ * @param data Payload
+ * @param size Length of payload
+ * @param document Output parsed document
+ * @return False if payload is not a JSON object or array
+ */
+bool parseJsonPayload(const char* data, size_t size, QJsonDocument& document)
+{
+    // Cheap check avoids running the parser on plain values
+    size_t start = 0;
+    while (start < size && (data[start] == ' ' || data[start] == '\t' || data[start] == '\r' || data[start] == '\n')){
+        start++;
+    }
+    if (start == size || (data[start] != '{' && data[start] != '[')){
+        return false;
+    }
+    QJsonParseError error;
+    document = QJsonDocument::fromJson(QByteArray::fromRawData(data, int(size)), &error);
+    return error.error == QJsonParseError::NoError;
+}
+
+/**
+ * Parses payload once for all its users, e.g. history message and every dashboard tile showing it.
+ * Document is kept while the payload buffer exists, safe to call from any thread.
+ * @param payload Shared payload
+ * @return Parsed payload, nullptr if payload is not a JSON object or array
+ */
+std::shared_ptr<const QJsonDocument> sharedJsonPayload(const mqtt::binary_ref& payload)
+{
+    if (!payload || payload.empty()){
+        return nullptr;
+    }
+    const std::string* key = payload.ptr().get();
+    {
+        std::lock_guard<std::mutex> lock(parsedMutex);
+        auto it = parsedPayloads.find(key);
+        // Address of freed buffer may be reused by another payload
+        if (it != parsedPayloads.end() && !it->second.payload.expired()){
+            return it->second.document;
+        }
+    }
+    auto document = std::make_shared<QJsonDocument>();
+    std::shared_ptr<const QJsonDocument> parsed;
+    if (parseJsonPayload(payload.data(), payload.size(), *document)){
+        parsed = std::move(document);
+    }
+    std::lock_guard<std::mutex> lock(parsedMutex);
+    ParsedPayload& entry = parsedPayloads[key];
+    if (entry.payload.expired()){
+        entry.payload = payload.ptr();
+        entry.document = parsed;
+    }
+    if (parsedPayloads.size() >= parsedPurgeSize){
+        for (auto it = parsedPayloads.begin(); it != parsedPayloads.end();){
+            if (it->second.payload.expired()){
+                it = parsedPayloads.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        parsedPurgeSize = std::max<size_t>(1024, parsedPayloads.size() * 2);
+    }
+    return entry.document;
+}
+
+/**
+ * Finds field of document
+ * @param document Parsed payload
+ * @param path Field path, $ alone is the whole document
+ * @param value Output field value
+ * @return False if path is invalid or the field does not exist
+ */
+bool jsonField(const QJsonDocument& document, const std::string& path, QJsonValue& value)
+{
+    if (path.empty() || path[0] != '$'){
+        return false;
+    }
+    value = document.isArray() ? QJsonValue(document.array()) : QJsonValue(document.object());
+    size_t pos = 1;
+    while (pos < path.size()){
+        if (path[pos] == '.'){
+            size_t end = path.find_first_of(".[", pos + 1);
+            if (end == std::string::npos){
+                end = path.size();
+            }
+            if (!value.isObject() || end == pos + 1){
+                return false;
+            }
+            value = value.toObject().value(QString::fromStdString(path.substr(pos + 1, end - pos - 1)));
+            pos = end;
+        } else if (path[pos] == '['){
+            size_t end = path.find(']', pos);
+            if (!value.isArray() || end == std::string::npos || end == pos + 1){
+                return false;
+            }
+            int index = 0;
+            for (size_t i = pos + 1; i < end; i++){
+                if (path[i] < '0' || path[i] > '9'){
+                    return false;
+                }
+                index = index * 10 + (path[i] - '0');
+            }
+            value = value.toArray().at(index);
+            pos = end + 1;
+        } else {
+            return false;
+        }
+        if (value.isUndefined()){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Formats JSON value for display, objects and arrays are printed compact
+ * @param value JSON value
+ * @return Text of value, strings without quotes
+ */
+QString jsonText(const QJsonValue& value)
+{
+    switch (value.type()){
+        case QJsonValue::String:
+            return value.toString();
+        case QJsonValue::Double:
+            return QString::number(value.toDouble(), 'g', 15);
+        case QJsonValue::Bool:
+            return value.toBool() ? "true" : "false";
+        case QJsonValue::Null:
+            return "null";
+        case QJsonValue::Object:
+            return QString::fromUtf8(QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact));
+        case QJsonValue::Array:
+            return QString::fromUtf8(QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact));
+        default:
+            return QString();
+    }
+}
+
+/**
+ * Adds value as child of tree item, objects and arrays become collapsible subtrees
+ * @param parent Parent item
+ * @param key Name of field or array index
+ * @param path Field path of value, shown as tool tip for use in dashboard
+ * @param value JSON value
+ */
+static void addJsonItem(QTreeWidgetItem* parent, const QString& key, const QString& path, const QJsonValue& value)
+{
+    auto* item = new QTreeWidgetItem(parent, QStringList{key});
+    item->setToolTip(0, path);
+    if (value.isObject()){
+        QJsonObject object = value.toObject();
+        item->setText(1, QString("{%1}").arg(object.size()));
+        for (auto it = object.begin(); it != object.end(); ++it){
+            addJsonItem(item, it.key(), path + '.' + it.key(), it.value());
+        }
+    } else if (value.isArray()){
+        QJsonArray array = value.toArray();
+        item->setText(1, QString("[%1]").arg(array.size()));
+        for (int i = 0; i < array.size(); i++){
+            addJsonItem(item, QString("[%1]").arg(i), path + QString("[%1]").arg(i), array.at(i));
+        }
+    } else {
+        item->setText(1, value.isString() ? '"' + value.toString() + '"' : jsonText(value));
+    }
+}
+
+/**
+ * Shows document as tree with columns field and value, first level is expanded
+ * @param tree Tree widget with two columns
+ * @param document Parsed payload
+ */
+void fillJsonTree(QTreeWidget* tree, const QJsonDocument& document)
+{
+    tree->clear();
+    tree->setColumnCount(2);
+    tree->setHeaderLabels({"Field", "Value"});
+    QJsonValue root = document.isArray() ? QJsonValue(document.array()) : QJsonValue(document.object());
+    addJsonItem(tree->invisibleRootItem(), "$", "$", root);
+    tree->expandToDepth(0);
+}
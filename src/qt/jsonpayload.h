@@ -0,0 +1,24 @@
+/** @file jsonpayload.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Access to fields of JSON payloads. Field path starts with $ followed by .name and [index] steps,
+ *  e.g. $.sensors[0].temp
+ */
+#ifndef JSONPAYLOAD_H
+#define JSONPAYLOAD_H
+
+#include <QJsonDocument>
+#include <QJsonValue>
+#include <QTreeWidget>
+#include <memory>
+#include <string>
+#include "mqtt/async_client.h"
+
+bool parseJsonPayload(const char* data, size_t size, QJsonDocument& document);
+std::shared_ptr<const QJsonDocument> sharedJsonPayload(const mqtt::binary_ref& payload);
+bool jsonField(const QJsonDocument& document, const std::string& path, QJsonValue& value);
+QString jsonText(const QJsonValue& value);
+void fillJsonTree(QTreeWidget* tree, const QJsonDocument& document);
+
+#endif // JSONPAYLOAD_H
@@ -8,11 +8,13 @@
 #include <utility>
 #include <QSettings>
 #include <QFileDialog>
+#include <QLocale>
 #include <fstream>
 #include "ui_mainwindow.h"
-#include "dashboarditemwidget.h"
+#include "dashboardcanvas.h"
 #include "dashboardarrangedialog.h"
 #include "messageviewdialog.h"
+#include "searchdialog.h"
 
 /** Main window constructor */
 MainWindow::MainWindow(QWidget *parent) :
@@ -22,17 +24,15 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
     Q_INIT_RESOURCE(resources);
 
-    // Load demo dashboard if config file does not exist
-    QFile file(dashboardSettings.fileName());
-    if (!file.exists()){
-        QFile demo_dashboard(":/demo-dashboard.conf");
-        demo_dashboard.open(QIODevice::ReadOnly);
-        file.open(QIODevice::WriteOnly);
-        file.write(demo_dashboard.readAll());
-        file.flush();
-        dashboardSettings.sync();
+    // Convert dashboard of older versions, or the demo dashboard when there is none
+    if (!dashboardConfig.exists()){
+        if (QFile::exists(dashboardSettings.fileName())){
+            dashboardConfig.migrate(dashboardSettings);
+        } else {
+            QSettings demo(":/demo-dashboard.conf", QSettings::IniFormat);
+            dashboardConfig.migrate(demo);
+        }
     }
-    file.close();
 
     connect(ui->connect_button, &QPushButton::clicked, this, [&](){connectAction();});
     connect(ui->pushButton_disconnect, &QPushButton::clicked, this, [&](){disconnectAction();});
@@ -41,12 +41,20 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->treeView->setHeaderHidden(true);
     ui->treeView->setSelectionMode(QAbstractItemView::SingleSelection);
     connect(ui->pushButton_publish, &QPushButton::clicked, this, &MainWindow::publishAction);
+    connect(ui->pushButton_latency, &QPushButton::clicked, this, &MainWindow::latencyAction);
+    connect(ui->pushButton_search, &QPushButton::clicked, this, &MainWindow::searchAction);
+    connect(ui->pushButton_record, &QPushButton::toggled, this, &MainWindow::recordAction);
     connect(ui->listView, &QListView::doubleClicked, this, &MainWindow::historyItemClicked);
     connect(ui->save_button, &QPushButton::clicked, this, &MainWindow::saveButtonAction);
     ui->lineEdit_host->setText(settings.value("login/hostname").toString());
     ui->lineEdit_port->setText(settings.value("login/port").toString());
     ui->lineEdit_username->setText(settings.value("login/username").toString());
     ui->lineEdit_password->setText(settings.value("login/password").toString());
+    ui->checkBox_worker->setChecked(settings.value("login/worker").toBool());
+    ui->checkBox_persistent->setChecked(settings.value("login/persistent").toBool());
+    ui->checkBox_collapse->setChecked(settings.value("login/collapse").toBool());
+    ui->checkBox_mqtt5->setChecked(settings.value("login/mqtt5").toBool());
+    ui->checkBox_latency->setChecked(settings.value("login/latency").toBool());
     connect(ui->combobox_inputType, static_cast<void (QComboBox::*)(int index)>(&QComboBox::currentIndexChanged),
             this, &MainWindow::inputTypeComboBoxChanged);
     connect(ui->inputFileBrowseButton, &QPushButton::clicked, this, &MainWindow::filePickerAction);
@@ -57,20 +65,18 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->pushButton_disconnect_2, &QPushButton::clicked, this, [&](){disconnectAction();});
 
     dashboardModel = std::make_shared<QStandardItemModel>();
-    dashboardModel->setRowCount(10);
+    dashboardModel->setRowCount(100);
     dashboardModel->setColumnCount(4);
-    for (int i = 0; i<4;i++){
-        ui->dashboardGridlayout->setColumnStretch(i,1);
-    }
-    for (int i = 0; i<5;i++){
-        ui->dashboardGridlayout->setRowStretch(i,1);
-    }
+    ui->dashboardCanvas->setColumnCount(4);
     connect(ui->editDashboardButton, &QToolButton::clicked, this, &MainWindow::dashBoardEditButtonAction);
 }
 
 /** Main window destructor */
 MainWindow::~MainWindow()
 {
+    if (mqttclient){
+        mqttclient->set_state_handler(nullptr);
+    }
     delete ui;
 }
 
@@ -138,13 +144,26 @@ void MainWindow::publishAction()
 {
     try{
         if (ui->combobox_inputType->currentIndex() == 1){
-            if (ui->inputFilenameLineEdit->text().isEmpty()){
-                throw std::invalid_argument("File path is empty");
+            // File is published in background, progress comes from its thread
+            mqttclient->publish_file(ui->topicLineEdit->text().toStdString(),
+                                     ui->inputFilenameLineEdit->text().toStdString(), 1, false,
+                                     [this](const PublishProgress& progress){
+                QMetaObject::invokeMethod(this, [this, progress](){ filePublishProgress(progress); },
+                                          Qt::QueuedConnection);
+            });
+            ui->pushButton_publish->setEnabled(false);
+        } else if (ui->combobox_inputType->currentIndex() == 2){
+            std::ifstream script(ui->inputFilenameLineEdit->text().toStdString());
+            if (!script){
+                throw std::invalid_argument("Cannot open batch script");
             }
-            std::ifstream infile(ui->inputFilenameLineEdit->text().toStdString(), std::ios::binary);
-            std::string content((std::istreambuf_iterator<char>(infile)), (std::istreambuf_iterator<char>()));
-            mqttclient->send_message(ui->topicLineEdit->text().toStdString(),
-                                     content);
+            double rate;
+            auto entries = Mqttcore::parse_batch_script(script, rate);
+            mqttclient->publish_batch(std::move(entries), rate, BATCH_WINDOW, [this](const BatchProgress& progress){
+                QMetaObject::invokeMethod(this, [this, progress](){ batchPublishProgress(progress); },
+                                          Qt::QueuedConnection);
+            });
+            ui->pushButton_publish->setEnabled(false);
         } else {
             mqttclient->send_message(ui->topicLineEdit->text().toStdString(),
                                      ui->inputTextEdit->toPlainText().toStdString());
@@ -164,6 +183,60 @@ void MainWindow::publishAction()
     }
 }
 
+/**
+ * Shows progress of file publishing, Publish button is enabled again when the file is delivered or on failure
+ * @param progress Current progress
+ */
+void MainWindow::filePublishProgress(const PublishProgress& progress)
+{
+    QString size = QLocale().formattedDataSize(progress.bytes);
+    switch (progress.stage){
+        case PublishProgress::MAPPED:
+            ui->label_publishStatus->setText("Sending " + size);
+            break;
+        case PublishProgress::SENT:
+            ui->label_publishStatus->setText("Waiting for delivery of " + size);
+            break;
+        case PublishProgress::DELIVERED:
+            ui->label_publishStatus->setText("Delivered " + size);
+            ui->pushButton_publish->setEnabled(true);
+            break;
+        case PublishProgress::FAILED: {
+            ui->label_publishStatus->setText("Failed");
+            ui->pushButton_publish->setEnabled(true);
+            QMessageBox errorBox;
+            std::string message = std::string("Error sending message\n") + progress.error;
+            errorBox.setText(message.c_str());
+            errorBox.setIcon(QMessageBox::Critical);
+            errorBox.exec();
+            break;
+        }
+    }
+}
+
+/**
+ * Shows progress of batch publishing, result is summarized when the batch is finished
+ * @param progress Current progress
+ */
+void MainWindow::batchPublishProgress(const BatchProgress& progress)
+{
+    QString status = QString("%1/%2 delivered, %3 failed, %4 msg/s")
+            .arg(progress.delivered).arg(progress.total).arg(progress.failed).arg(progress.rate(), 0, 'f', 1);
+    if (!progress.finished){
+        ui->label_publishStatus->setText("Sending " + status);
+        return;
+    }
+    ui->label_publishStatus->setText(status + QString(" in %1 s").arg(progress.seconds, 0, 'f', 1));
+    ui->pushButton_publish->setEnabled(true);
+    if (progress.failed > 0){
+        QMessageBox errorBox;
+        std::string message = "Error sending " + std::to_string(progress.failed) + " messages\n" + progress.error;
+        errorBox.setText(message.c_str());
+        errorBox.setIcon(QMessageBox::Warning);
+        errorBox.exec();
+    }
+}
+
 /**
  * Set client
  */
@@ -171,21 +244,33 @@ bool MainWindow::setClient(std::shared_ptr<Mqttclient> client)
 {
     mqttclient = std::move(client);
     ui->treeView->setModel(mqttclient->itemModel.get());
+    mqttclient->set_state_handler([this](ConnectionState state, const std::string& detail){
+        QString text = QString::fromStdString(detail);
+        QMetaObject::invokeMethod(this, [this, text](){ ui->label_connection->setText(text); }, Qt::QueuedConnection);
+    });
+    ui->dashboardCanvas->setTileFactory([this](const DashboardItemData& data){
+        return DashboardTile::create(data, mqttclient, ui->dashboardCanvas);
+    });
+    loadDashboard();
     return true;
 }
 
 /**
- * Connects GUI actions
+ * Starts connecting and switches to explorer, connection state is shown in explorer top bar
  */
 void MainWindow::connectAction()
 {
     try {
+        mqttclient->use_consumer_queue = ui->checkBox_worker->isChecked();
+        mqttclient->persistent_session = ui->checkBox_persistent->isChecked();
+        mqttclient->collapse_repeated = ui->checkBox_collapse->isChecked();
+        mqttclient->use_mqtt5 = ui->checkBox_mqtt5->isChecked();
+        mqttclient->measure_latency = ui->checkBox_latency->isChecked();
         mqttclient->connect(ui->lineEdit_host->text().toStdString(), ui->lineEdit_port->text().toStdString(),
         ui->lineEdit_username->text().toStdString(), ui->lineEdit_password->text().toStdString());
         ui->treeView->setModel(mqttclient->itemModel.get());
         connect(ui->treeView->selectionModel(), &QItemSelectionModel::selectionChanged, this, &MainWindow::newSelection);
         ui->stackedWidget->setCurrentWidget(ui->explorer);
-        loadDashboard();
     } catch (mqtt::exception& error){
         QMessageBox errorBox;
         std::string message = std::string("Unable to connect to MQTT server\n") + error.what();
@@ -203,6 +288,11 @@ void MainWindow::saveButtonAction(){
     settings.setValue("login/port", ui->lineEdit_port->text());
     settings.setValue("login/username", ui->lineEdit_username->text());
     settings.setValue("login/password", ui->lineEdit_password->text());
+    settings.setValue("login/worker", ui->checkBox_worker->isChecked());
+    settings.setValue("login/persistent", ui->checkBox_persistent->isChecked());
+    settings.setValue("login/collapse", ui->checkBox_collapse->isChecked());
+    settings.setValue("login/mqtt5", ui->checkBox_mqtt5->isChecked());
+    settings.setValue("login/latency", ui->checkBox_latency->isChecked());
 }
 
 /**
@@ -210,6 +300,7 @@ void MainWindow::saveButtonAction(){
  */
 void MainWindow::disconnectAction()
 {
+    ui->pushButton_record->setChecked(false);
     mqttclient->stop();
     ui->stackedWidget->setCurrentWidget(ui->login);
 }
@@ -222,10 +313,10 @@ void MainWindow::closeEvent(QCloseEvent *event)
     QMainWindow::closeEvent(event);
 }
 /**
- * Switch between text and file input widget
+ * Switch between text and file input widget, batch script is selected as a file
  */
 void MainWindow::inputTypeComboBoxChanged(int index) {
-    if (index == 1){
+    if (index >= 1){
         ui->stackedWidget_input->setCurrentWidget(ui->fileInputPage);
     } else {
         ui->stackedWidget_input->setCurrentWidget(ui->textInputPage);
@@ -256,37 +347,20 @@ void MainWindow::dashBoardEditButtonAction(){
 }
 
 /**
- * Add new widget to dashboard layout or replace old
- * @param data for widget
+ * Add new tile to dashboard or replace old
+ * @param data for tile
  */
 void MainWindow::addDashBoardWidget(const DashboardItemData& data) {
-    QStandardItem* topicItem = mqttclient->getTopicItem(mqttclient->itemModel.get(), data.stateTopic);
-    if (topicItem->data().isNull()){
-        QVariant variant;
-        auto* topicData = new Topicdata();
-        variant.setValue(topicData);
-        topicItem->setData(variant);
-    }
-    auto* item = new DashboardItemWidget(ui->dashboardGridWidget, data, topicItem, mqttclient);
-    if (ui->dashboardGridlayout->itemAtPosition(data.row, data.column) != nullptr){
-        auto item = ui->dashboardGridlayout->itemAtPosition(data.row, data.column);
-        ui->dashboardGridlayout->removeItem(item);
-        item->widget()->deleteLater();
-    }
-    ui->dashboardGridlayout->addWidget(item, data.row, data.column, 1, 1);
+    ui->dashboardCanvas->setTile(data);
 }
 
 /**
- * Remove widget from layout and delete it
+ * Remove tile from dashboard and delete it
  * @param row
  * @param collumn
  */
 void MainWindow::removeDashboardWidget(int row, int collumn){
-    if (ui->dashboardGridlayout->itemAtPosition(row, collumn) != nullptr){
-        auto item = ui->dashboardGridlayout->itemAtPosition(row, collumn);
-        ui->dashboardGridlayout->removeItem(item);
-        item->widget()->deleteLater();
-    }
+    ui->dashboardCanvas->removeTile(row, collumn);
 }
 
 /**
@@ -302,34 +376,21 @@ void MainWindow::historyItemClicked(const QModelIndex& index) {
 }
 
 /**
- * Load full dashboard from configuration file
+ * Load full dashboard from configuration file, tiles are created when they become visible
  */
 void MainWindow::loadDashboard(){
-    DashboardItemData* data;
-    for (const auto& group: dashboardSettings.childGroups()){
-        data = new DashboardItemData();
-        dashboardSettings.beginGroup(group);
-        auto position = group.split('-');
-        data->row = position[0].toUInt();
-        data->column = position[1].toUInt();
-        data->name = dashboardSettings.value("name").toString().toStdString();
-        data->type = dashboardSettings.value("type").toString().toStdString();
-
-        data->onOffType = dashboardSettings.value("onOffType").toString().toStdString();
-        data->stateTopic = dashboardSettings.value("stateTopic").toString().toStdString();
-        data->offStateMessage = dashboardSettings.value("offStateMessage").toString().toStdString();
-        data->onStateMessage = dashboardSettings.value("onStateMessage").toString().toStdString();
-        data->controllable = dashboardSettings.value("controllable").toBool();
-        data->controlTopic = dashboardSettings.value("controlTopic").toString().toStdString();
-        data->turnOffCommand = dashboardSettings.value("turnOffCommand").toString().toStdString();
-        data->turnOnCommand = dashboardSettings.value("turnOnCommand").toString().toStdString();
-        dashboardSettings.endGroup();
+    dashboardModel->clear();
+    dashboardModel->setRowCount(100);
+    dashboardModel->setColumnCount(4);
+    ui->dashboardCanvas->clear();
+    for (const auto& it: dashboardConfig.load()){
+        auto* data = new DashboardItemData(it);
         auto *item = new QStandardItem(data->name.data());
         QVariant variant;
         variant.setValue(data);
         item->setData(variant, Qt::UserRole+1);
         dashboardModel->setItem(data->row, data->column, item);
-        addDashBoardWidget(*data);
+        ui->dashboardCanvas->setTile(*data);
     }
 }
 
@@ -338,20 +399,7 @@ void MainWindow::loadDashboard(){
  * @param data
  */
 void MainWindow::saveDashboardItemSettings(DashboardItemData data) {
-    auto group = std::to_string(data.row) + "-" + std::to_string(data.column);
-    dashboardSettings.beginGroup(group.data());
-    dashboardSettings.setValue("name", data.name.data());
-    dashboardSettings.setValue("type", data.type.data());
-
-    dashboardSettings.setValue("onOffType", data.onOffType.data());
-    dashboardSettings.setValue("stateTopic", data.stateTopic.data());
-    dashboardSettings.setValue("offStateMessage", data.offStateMessage.data());
-    dashboardSettings.setValue("onStateMessage", data.onStateMessage.data());
-    dashboardSettings.setValue("controllable", data.controllable);
-    dashboardSettings.setValue("controlTopic", data.controlTopic.data());
-    dashboardSettings.setValue("turnOffCommand", data.turnOffCommand.data());
-    dashboardSettings.setValue("turnOnCommand", data.turnOnCommand.data());
-    dashboardSettings.endGroup();
+    dashboardConfig.save(data);
 }
 
 /**
@@ -360,10 +408,102 @@ void MainWindow::saveDashboardItemSettings(DashboardItemData data) {
  * @param column
  */
 void MainWindow::removeDashboardItemSettings(int row, int column) {
-    auto group = std::to_string(row) + "-" + std::to_string(column);
-    dashboardSettings.beginGroup(group.data());
-    dashboardSettings.remove("");
-    dashboardSettings.endGroup();
+    dashboardConfig.remove(row, column);
+}
+
+/**
+ * Show end-to-end latency statistics of messages carrying simulator latency header
+ */
+void MainWindow::latencyAction() {
+    QMessageBox reportBox;
+    reportBox.setWindowTitle("Latency");
+    if (mqttclient->latency.empty()){
+        reportBox.setText("No messages with latency header received.\nEnable LATENCY in simulator configuration and Measure latency before connecting.");
+    } else {
+        reportBox.setText("End-to-end latency per topic");
+        reportBox.setDetailedText(mqttclient->latency.report().c_str());
+    }
+    QString info;
+    if (mqttclient->use_consumer_queue){
+        IngestStats ingest = mqttclient->ingest_stats();
+        info = QString("Worker queue: %1 waiting, %2 processed in %3 batches, largest batch %4\n")
+                .arg(ingest.queued()).arg(ingest.processed).arg(ingest.batches).arg(ingest.max_batch);
+    }
+    Payloadstore::Stats stored = mqttclient->payloads.stats();
+    info += QString("Payloads: %1 distinct, %2 duplicates sharing a copy, %3 saved")
+            .arg(stored.distinct).arg(stored.duplicates).arg(QLocale().formattedDataSize(stored.saved_bytes));
+    reportBox.setInformativeText(info);
+    reportBox.exec();
+}
+
+/**
+ * Open dialog searching payloads of message history
+ */
+void MainWindow::searchAction() {
+    auto* searchDialog = new SearchDialog(mqttclient, this);
+    connect(searchDialog, &SearchDialog::messageSelected, this, &MainWindow::showHistoryMessage);
+    searchDialog->setAttribute(Qt::WA_DeleteOnClose, true);
+    searchDialog->show();
+}
+
+/**
+ * Selects topic in explorer tree and opens its history message received at given time
+ * @param topic Full topic name
+ * @param receivedTimeNs Receive time in ns since epoch
+ */
+void MainWindow::showHistoryMessage(const QString& topic, qint64 receivedTimeNs) {
+    ui->stackedWidget->setCurrentWidget(ui->explorer);
+    QStandardItem* topicItem = Mqttclient::getTopicItem(mqttclient->itemModel.get(), topic.toStdString());
+    ui->treeView->setCurrentIndex(topicItem->index());
+    auto* ptr = topicItem->data().value<Topicdata*>();
+    if (ptr == nullptr){
+        return;
+    }
+    for (int row = ptr->messages.rowCount() - 1; row >= 0; row--){
+        QModelIndex index = ptr->messages.index(row, 0);
+        auto* message = index.data(Qt::UserRole + 1).value<TopicMessage*>();
+        auto first = std::chrono::duration_cast<std::chrono::nanoseconds>(message->received_time.time_since_epoch());
+        auto last = std::chrono::duration_cast<std::chrono::nanoseconds>(message->last_received_time.time_since_epoch());
+        // Collapsed entry covers all its repeats
+        if (first.count() <= receivedTimeNs && receivedTimeNs <= last.count()){
+            ui->listView->setCurrentIndex(index);
+            historyItemClicked(index);
+            return;
+        }
+    }
+}
+
+/**
+ * Start or finish recording of received messages into capture file
+ * @param checked True to start recording
+ */
+void MainWindow::recordAction(bool checked) {
+    if (checked){
+        if (mqttclient->capture.active()){
+            return;
+        }
+        auto fileName = QFileDialog::getSaveFileName(this, tr("Record to capture file"), "capture.mqcap",
+                                                     tr("Capture files (*.mqcap)"));
+        if (fileName.isEmpty() || !mqttclient->capture.start(fileName.toStdString())){
+            ui->pushButton_record->setChecked(false);
+            if (!fileName.isEmpty()){
+                QMessageBox::critical(this, "Record", "Unable to create capture file");
+            }
+            return;
+        }
+        ui->pushButton_record->setText("Stop recording");
+    } else {
+        ui->pushButton_record->setText("Record");
+        if (!mqttclient->capture.active()){
+            return;
+        }
+        mqttclient->capture.stop();
+        std::string message = "Recorded " + std::to_string(mqttclient->capture.recorded()) + " messages";
+        if (mqttclient->capture.dropped() > 0){
+            message += ", " + std::to_string(mqttclient->capture.dropped()) + " dropped";
+        }
+        QMessageBox::information(this, "Record", message.c_str());
+    }
 }
 
 /**
@@ -11,9 +11,11 @@
 #include <QStandardItemModel>
 #include <QItemSelection>
 #include <QSettings>
+#include <QFileInfo>
 #include <QPointer>
 #include "dashboarditemformdialog.h"
-#include "dashboarditemwidget.h"
+#include "dashboarditemdata.h"
+#include "dashboardconfig.h"
 
 namespace Ui {
 class MainWindow;
@@ -24,7 +26,10 @@ class MainWindow : public QMainWindow
     Q_OBJECT
     std::shared_ptr<Mqttclient> mqttclient;
     QSettings settings{"xmanak20-xbreza01", "MQTT Explorer"};
+    /** Dashboard settings of older versions, only converted to dashboardConfig */
     QSettings dashboardSettings{"xmanak20-xbreza01", "MQTT Explorer-dashboard"};
+    DashboardConfig dashboardConfig{QFileInfo(dashboardSettings.fileName()).absolutePath()
+                                    + "/MQTT Explorer-dashboard.jsonl"};
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
@@ -48,6 +53,12 @@ public slots:
     void removeDashboardItemSettings(int row, int column);
     void historyItemClicked(const QModelIndex& index);
     void loadDashboard();
+    void latencyAction();
+    void recordAction(bool checked);
+    void filePublishProgress(const PublishProgress& progress);
+    void searchAction();
+    void showHistoryMessage(const QString& topic, qint64 receivedTimeNs);
+    void batchPublishProgress(const BatchProgress& progress);
 
 private:
     Ui::MainWindow *ui;
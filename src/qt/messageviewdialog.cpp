@@ -7,6 +7,7 @@
 #include "messageviewdialog.h"
 #include <iostream>
 #include "ui_messageviewdialog.h"
+#include "jsonpayload.h"
 
 /** Constructor */
 MessageViewDialog::MessageViewDialog(QWidget *parent) :
@@ -29,16 +30,27 @@ MessageViewDialog::~MessageViewDialog()
 void MessageViewDialog::setMessage(TopicMessage *message) {
     time_t time = std::chrono::system_clock::to_time_t(message->received_time);
     char * timestamptext = ctime(&time);
-    ui->timestamp->setText(timestamptext);
+    QString timestamp = QString(timestamptext).trimmed();
+    if (message->repeats > 1){
+        time_t last = std::chrono::system_clock::to_time_t(message->last_received_time);
+        timestamp += QString(" - %1 (%2 times)").arg(QString(ctime(&last)).trimmed()).arg(message->repeats);
+    }
+    ui->timestamp->setText(timestamp);
+    if (const QJsonDocument* document = message->json()){
+        ui->stackedWidget->setCurrentIndex(2);
+        fillJsonTree(ui->jsonTree, *document);
+        return;
+    }
+    mqtt::binary payload = message->get_payload();
     auto * image = new QPixmap();
-    uint len = message->payload.length()*sizeof(uchar);
-    const uchar *buf = (uchar*)message->payload.data();
+    uint len = payload.length()*sizeof(uchar);
+    const uchar *buf = (uchar*)payload.data();
     if (image->loadFromData(buf, len, nullptr, Qt::AutoColor)){
         ui->stackedWidget->setCurrentIndex(1);
         ui->imageLabel->setPixmap(*image);
     } else {
         ui->stackedWidget->setCurrentIndex(0);
-        ui->textEdit->setText(message->payload.data());
+        ui->textEdit->setText(payload.data());
     }
     delete image;
 }
@@ -4,6 +4,7 @@
  */
 #include "messageviewwidget.h"
 #include "ui_messageviewwidget.h"
+#include "jsonpayload.h"
 
 MessageViewWidget::MessageViewWidget(QWidget *parent) :
     QWidget(parent),
@@ -19,7 +20,7 @@ MessageViewWidget::~MessageViewWidget()
 }
 
 /**
- * Show text or image on view
+ * Show text, JSON tree or image on view
  * @param message
  */
 void MessageViewWidget::setMessage(TopicMessage *message) {
@@ -28,15 +29,21 @@ void MessageViewWidget::setMessage(TopicMessage *message) {
         ui->stackedWidget->setCurrentIndex(0);
         return;
     }
+    if (const QJsonDocument* document = message->json()){
+        ui->stackedWidget->setCurrentIndex(2);
+        fillJsonTree(ui->jsonTree, *document);
+        return;
+    }
+    mqtt::binary payload = message->get_payload();
     auto * image = new QPixmap();
-    uint len = message->payload.length()*sizeof(uchar);
-    const uchar *buf = (uchar*)message->payload.data();
+    uint len = payload.length()*sizeof(uchar);
+    const uchar *buf = (uchar*)payload.data();
     if (image->loadFromData(buf, len, nullptr, Qt::AutoColor)){
         ui->stackedWidget->setCurrentIndex(1);
         ui->imgLabel->setPixmap(*image);
     } else {
         ui->stackedWidget->setCurrentIndex(0);
-        ui->textEdit->setText(message->payload.data());
+        ui->textEdit->setText(payload.data());
     }
     delete image;
 }
@@ -0,0 +1,60 @@
+/**
+ *  @file searchdialog.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#include "searchdialog.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include "ui_searchdialog.h"
+
+/**
+ * Constructor
+ * @param client Client whose history is searched
+ * @param parent Parent widget
+ */
+SearchDialog::SearchDialog(std::shared_ptr<Mqttclient> client, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::SearchDialog),
+    client(std::move(client))
+{
+    ui->setupUi(this);
+    connect(ui->lineEdit_search, &QLineEdit::returnPressed, this, [this](){ search(ui->lineEdit_search->text()); });
+    connect(ui->listWidget_results, &QListWidget::itemDoubleClicked, this, [this](QListWidgetItem* item){
+        const auto& result = results.at(ui->listWidget_results->row(item));
+        emit messageSelected(QString::fromStdString(result.topic),
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     result.received_time.time_since_epoch()).count());
+    });
+}
+
+/** Destructor */
+SearchDialog::~SearchDialog()
+{
+    delete ui;
+}
+
+/**
+ * Lists messages containing text, newest first
+ * @param text Searched text
+ */
+void SearchDialog::search(const QString& text)
+{
+    ui->lineEdit_search->setText(text);
+    ui->listWidget_results->clear();
+    QElapsedTimer timer;
+    timer.start();
+    results = client->search.search(text.toStdString(), MAX_RESULTS);
+    qint64 elapsed = timer.elapsed();
+    for (const auto& result: results){
+        QDateTime time = QDateTime::fromMSecsSinceEpoch(std::chrono::duration_cast<std::chrono::milliseconds>(
+                result.received_time.time_since_epoch()).count());
+        QString payload = QString::fromUtf8(result.payload.data(), int(std::min<size_t>(result.payload.size(), 100)));
+        ui->listWidget_results->addItem(time.toString("yyyy-MM-dd hh:mm:ss.zzz") + "  "
+                                        + QString::fromStdString(result.topic) + "  " + payload.simplified());
+    }
+    ui->label_summary->setText(QString("%1%2 messages of %3 in %4 ms")
+            .arg(results.size() == MAX_RESULTS ? "First " : "").arg(results.size())
+            .arg(client->search.size()).arg(elapsed));
+}
@@ -0,0 +1,44 @@
+/**
+ *  @file searchdialog.h
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ */
+
+#ifndef SEARCHDIALOG_H
+#define SEARCHDIALOG_H
+
+#include <QDialog>
+#include "Mqttclient.h"
+
+namespace Ui {
+class SearchDialog;
+}
+
+/**
+ * Searches message history of the client and lists found messages
+ */
+class SearchDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    /** Maximal number of listed messages */
+    static const size_t MAX_RESULTS = 1000;
+
+    explicit SearchDialog(std::shared_ptr<Mqttclient> client, QWidget *parent = nullptr);
+    ~SearchDialog();
+
+public slots:
+    void search(const QString& text);
+
+signals:
+    /** Emitted on double click of found message */
+    void messageSelected(const QString& topic, qint64 receivedTimeNs);
+
+private:
+    Ui::SearchDialog *ui;
+    std::shared_ptr<Mqttclient> client;
+    std::vector<Searchindex::Result> results;
+};
+
+#endif // SEARCHDIALOG_H
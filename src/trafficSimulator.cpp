@@ -8,7 +8,10 @@
  * 		- A thernostat outputting integer values, value can be set using command "set <value>", current value then gradually changes every period until it equals the new one
  * 		- A camera which publishes new image from specified list every period
  *
- * Simulator configuration can be customized in file traffic.cfg
+ * Recorded capture file can be replayed with original, scaled or unlimited speed alongside the sensors.
+ *
+ * Simulator configuration can be customized in file traffic.cfg, sensors are declared by SENSOR lines
+ * which can expand into many instances using sensor templates, counts and topic patterns.
  */ 
 
 /**
@@ -19,23 +22,51 @@
 
 #include <iostream>
 #include <string>
-#include <sstream>
 #include <fstream>
-#include <iomanip>
+#include <cmath>
+#include <cstring>
 #include <atomic>
 #include <queue>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <deque>
+#include <unordered_map>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
+#include <cstdarg>
+#include <cstdio>
 #include "mqtt/async_client.h"
+#include "Latency.h"
+#include "Capturefile.h"
 
 //////////////////////////////////////////   THREAD COMMUNICATION   //////////////////////////////////////////
 /** Atomic variable used to signal other threads when to terminate */
 std::atomic <bool> halt(false);
-/** Atomic variable used to pass requested state to valve thread (-1 = no request, 0 = close, 1 = open) */
-std::atomic <int> cmd_valve = {-1};
-/** Atomic variable used to pass requested value to thermostat thread (for value to be set: -50 < value < 50) */
-std::atomic <int> cmd_ts = {-99};
+/** Embed sequence number and send timestamp into every payload (set from configuration before sensors start) */
+bool latency_mode = false;
+/** Quality of service of sensor messages (set from configuration before sensors start) */
+int sensor_qos = 0;
+/** Maximal number of messages taken from queue at once by publisher */
+const int PUBLISH_BATCH = 64;
+
+/** Function sleeps until deadline in short slices so a waiting thread notices halt
+ *  @param deadline Time to wake up
+ *  @return False if halt was signalled before the deadline
+ */
+bool sleep_until_or_halt(std::chrono::steady_clock::time_point deadline)
+{
+	const auto SLICE = std::chrono::milliseconds(100);
+	while(!halt.load()){
+		auto now = std::chrono::steady_clock::now();
+		if(now >= deadline) return true;
+		std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(deadline - now, SLICE));
+	}
+	return false;
+}
 
 /**
  * Class implementing a thread safe queue
@@ -65,76 +96,630 @@ public:
 		return val;
 	}
 
+	/** Function removes all queued elements up to a limit, waits until at least one is queued
+	 *  @param out Vector to append removed messages to
+	 *  @param max Maximal number of removed messages
+	 */
+	void dequeue_batch(std::vector<mqtt::message_ptr>& out, size_t max)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		while(q.empty()) c.wait(lock);
+		while(!q.empty() && max-- > 0){
+			out.push_back(std::move(q.front()));
+			q.pop();
+		}
+	}
+
+	/** @return Number of queued messages */
+	size_t size(void) const
+	{
+		std::lock_guard<std::mutex> lock(m);
+		return q.size();
+	}
+
 private:
 	std::queue<mqtt::message_ptr> q;
 	mutable std::mutex m;
 	std::condition_variable c;
 };
 
+/**
+ * Class implementing leveled asynchronous logger, lines are formatted by the caller into lock-free ring buffer
+ * and written by background thread, which also prints periodic statistics
+ */
+class Logger
+{
+public:
+	enum Level {ERROR, WARN, INFO, DEBUG};
+
+	Logger()
+	{
+		for(size_t i = 0; i < SLOTS; i++) slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	/** Function starts background thread
+	 *  @param max_level Most verbose level to be logged
+	 *  @param stats_period Period of statistics lines, 0 = disabled
+	 *  @param stats Function formatting statistics line for elapsed seconds
+	 */
+	void start(Level max_level, std::chrono::milliseconds stats_period, std::function<std::string(double)> stats)
+	{
+		level = max_level;
+		period = stats_period;
+		stats_line = stats;
+		running = true;
+		writer = std::thread(&Logger::run, this);
+	}
+
+	/** Function flushes remaining lines and stops background thread */
+	void stop(void)
+	{
+		if(!running.exchange(false)) return;
+		writer.join();
+	}
+
+	/** @return True if lines of level are logged */
+	bool enabled(Level l) const
+	{
+		return l <= level;
+	}
+
+	/** Function formats line into buffer, line is dropped if buffer is full
+	 *  @param l Level of line
+	 *  @param format printf format
+	 */
+	void log(Level l, const char* format, ...)
+	{
+		if(!enabled(l)) return;
+		size_t pos = head.load(std::memory_order_relaxed);
+		Slot* slot;
+		while(true){
+			slot = &slots[pos & (SLOTS - 1)];
+			size_t seq = slot->seq.load(std::memory_order_acquire);
+			if(seq == pos){
+				if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			}
+			else if(seq < pos){
+				drops.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else pos = head.load(std::memory_order_relaxed);
+		}
+		static const char* names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+		int len = snprintf(slot->text, LINE, "[%s] ", names[l]);
+		va_list args;
+		va_start(args, format);
+		vsnprintf(slot->text + len, LINE - len, format, args);
+		va_end(args);
+		slot->seq.store(pos + 1, std::memory_order_release);
+	}
+
+	/** @return Number of dropped lines */
+	uint64_t dropped(void) const
+	{
+		return drops.load(std::memory_order_relaxed);
+	}
+
+private:
+	static const size_t SLOTS = 4096;	//power of two
+	static const size_t LINE = 256;
+
+	struct Slot{
+		std::atomic<size_t> seq;
+		char text[LINE];
+	};
+
+	Slot slots[SLOTS];
+	std::atomic<size_t> head{0};
+	size_t tail = 0;
+	std::atomic<uint64_t> drops{0};
+	std::atomic<bool> running{false};
+	Level level = INFO;
+	std::chrono::milliseconds period{0};
+	std::function<std::string(double)> stats_line;
+	std::thread writer;
+
+	/** Function writes all buffered lines
+	 *  @return Number of written lines
+	 */
+	size_t flush(void)
+	{
+		size_t count = 0;
+		while(true){
+			Slot &slot = slots[tail & (SLOTS - 1)];
+			if(slot.seq.load(std::memory_order_acquire) != tail + 1) break;
+			fputs(slot.text, stdout);
+			fputc('\n', stdout);
+			slot.seq.store(tail + SLOTS, std::memory_order_release);
+			tail++;
+			count++;
+		}
+		if(count) fflush(stdout);
+		return count;
+	}
+
+	/** Body of background thread */
+	void run(void)
+	{
+		auto last = std::chrono::steady_clock::now();
+		while(running.load()){
+			if(!flush()) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			auto now = std::chrono::steady_clock::now();
+			if(period.count() > 0 && now - last >= period){
+				std::string line = stats_line(std::chrono::duration<double>(now - last).count());
+				printf("[STATS] %s\n", line.c_str());
+				fflush(stdout);
+				last = now;
+			}
+		}
+		flush();
+	}
+};
+
+/** Logger shared by all threads */
+Logger logger;
+
+/**
+ * Class implementing command mailbox of one controllable device
+ */
+class Mailbox
+{
+public:
+	/** Function adds command and wakes up the device
+	 *  @param cmd Received command
+	 */
+	void post(const std::string& cmd)
+	{
+		std::lock_guard<std::mutex> lock(m);
+		q.push(cmd);
+		c.notify_one();
+	}
+
+	/** Function waits for next command
+	 *  @param cmd Output received command
+	 *  @param timeout Maximum waiting time
+	 *  @return True if command was received, false on timeout or termination
+	 */
+	bool wait(std::string& cmd, std::chrono::milliseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		if(!c.wait_for(lock, timeout, [this]{ return !q.empty() || closed; }) || q.empty()) return false;
+		cmd = q.front();
+		q.pop();
+		return true;
+	}
+
+	/** Function wakes up waiting device so it can terminate */
+	void close(void)
+	{
+		std::lock_guard<std::mutex> lock(m);
+		closed = true;
+		c.notify_all();
+	}
+
+private:
+	std::queue<std::string> q;
+	bool closed = false;
+	std::mutex m;
+	std::condition_variable c;
+};
+
+/**
+ * Class routing received commands to mailboxes of devices by command topic
+ */
+class CommandRouter
+{
+public:
+	/** Function registers device command topic, must be called before subscribing
+	 *  @param topic Command topic of device
+	 *  @param filter Subscription filter covering topic
+	 *  @return Mailbox of device
+	 */
+	Mailbox* add(const std::string& topic, const std::string& filter)
+	{
+		mailboxes.emplace_back();
+		routes[topic].push_back(&mailboxes.back());
+		filter_set.insert(filter);
+		return &mailboxes.back();
+	}
+
+	/** @return Subscription filters of all registered devices */
+	const std::set<std::string>& filters(void) const
+	{
+		return filter_set;
+	}
+
+	/** Function delivers command to all devices listening on topic
+	 *  @param topic Topic of received message
+	 *  @param cmd Received command
+	 *  @return False if no device listens on topic
+	 */
+	bool dispatch(const std::string& topic, const std::string& cmd) const
+	{
+		auto it = routes.find(topic);
+		if(it == routes.end()) return false;
+		for(auto mailbox: it->second) mailbox->post(cmd);
+		return true;
+	}
+
+	/** Function wakes up all devices so they can terminate */
+	void close(void)
+	{
+		for(auto &it: mailboxes) it.close();
+	}
+
+private:
+	std::deque<Mailbox> mailboxes;
+	std::unordered_map<std::string, std::vector<Mailbox*>> routes;
+	std::set<std::string> filter_set;
+};
+
+/**
+ * Class implementing fast pseudorandom generator (xoshiro256**) owned by a single sensor,
+ * generation does not lock and sequences of sensors are independent
+ */
+class Random
+{
+public:
+	/** Constructor seeds generator state by splitmix64
+	 *  @param seed Global seed of simulation
+	 *  @param id Identifier of sensor
+	 */
+	Random(uint64_t seed, uint64_t id)
+	{
+		uint64_t x = seed ^ (id * 0x9E3779B97F4A7C15ULL);
+		for(auto &it: s){
+			uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			it = z ^ (z >> 31);
+		}
+	}
+
+	/** @return Next 64 random bits */
+	uint64_t next(void)
+	{
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	/** @param n Upper bound
+	 *  @return Random integer in range [0, n)
+	 */
+	uint32_t uniform(uint32_t n)
+	{
+		return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+	}
+
+	/** @return Random float in range [0, 1) */
+	float uniform_float(void)
+	{
+		return (next() >> 40) * (1.0f / (1 << 24));
+	}
+
+	/** @return Random boolean */
+	bool coin(void)
+	{
+		return next() >> 63;
+	}
+
+private:
+	uint64_t s[4];
+
+	static uint64_t rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+};
+
 /**
  * Callback class used to receive messages
  */
 class Callback : public virtual mqtt::callback
 {
+public:
+	/** Constructor
+	 *  @param router Router of device commands
+	 */
+	explicit Callback(const CommandRouter& router) : router(router) {}
+
 	void message_arrived(mqtt::const_message_ptr msg) override
 	{
-		std::string topic = msg->get_topic();
+		logger.log(Logger::DEBUG, "Message arrived: %s %.100s", msg->get_topic().c_str(), msg->to_string().c_str());
+		if(!router.dispatch(msg->get_topic(), msg->to_string())){
+			logger.log(Logger::WARN, "No device listens on topic %s", msg->get_topic().c_str());
+		}
+	}
 
-		std::cout << "Message arrived" << std::endl;
-		std::cout << "\tTopic: " << topic << std::endl;
-		std::cout << "\tPayload: " << msg->to_string() << std::endl;
+	void delivery_complete(mqtt::delivery_token_ptr tok) override
+	{
+		delivered.fetch_add(1, std::memory_order_relaxed);
+		if(logger.enabled(Logger::DEBUG)) logger.log(Logger::DEBUG, "Delivered token: %d", tok->get_message_id());
+	}
 
-		if(topic == "valve/cmd"){
-			if(msg->to_string() == "open"){
-				std::cout << "Valve received open command" << std::endl;
-				cmd_valve = {1};
-			}
-			else if(msg->to_string() == "close"){
-				std::cout << "Valve received close command" << std::endl;
-				cmd_valve = {0};
+	/** Number of messages confirmed by server (QoS 1 and 2) */
+	std::atomic<uint64_t> delivered{0};
+
+private:
+	const CommandRouter& router;
+};
+
+
+//////////////////////////////////////////   PUBLISHING   //////////////////////////////////////////
+/**
+ * Class preparing messages for publishing, on MQTT v5 connection it assigns topic aliases and attaches user properties.
+ * First message of a topic carries the topic and its alias, later messages only the alias. Size of PUBLISH packets
+ * is estimated from the encoding of prepared messages, both as sent and as it would be without aliases; the loopback
+ * broker measures the real size on the wire.
+ */
+class PublishEncoder
+{
+public:
+	/** Constructor
+	 *  @param v5 Connection uses MQTT v5
+	 *  @param user_properties Name and value pairs attached to every message (MQTT v5 only)
+	 */
+	PublishEncoder(bool v5, const std::vector<std::pair<std::string, std::string>>& user_properties) : v5(v5)
+	{
+		if(!v5) return;
+		for(auto &it: user_properties){
+			base.add(mqtt::property(mqtt::property::USER_PROPERTY, it.first, it.second));
+			base_len += 5 + it.first.size() + it.second.size();
+		}
+	}
+
+	/** Function enables topic aliases, called before the first message is prepared
+	 *  @param max Number of topic aliases accepted by server
+	 */
+	void enable_aliases(int max)
+	{
+		alias_max = v5 ? max : 0;
+	}
+
+	/** Function sets alias and properties of message before publishing
+	 *  @param msg Message to be published
+	 */
+	void prepare(const mqtt::message_ptr& msg)
+	{
+		size_t topic_len = msg->get_topic().size();
+		size_t props_len = base_len;
+		size_t full_topic_len = topic_len;
+		if(alias_max > 0 && topic_len > 0){
+			auto it = aliases.find(msg->get_topic());
+			if(it == aliases.end() && aliases.size() < (size_t)alias_max){
+				Alias alias{(int)aliases.size() + 1, base};
+				alias.props.add(mqtt::property(mqtt::property::TOPIC_ALIAS, alias.id));
+				assigned.store(aliases.size() + 1, std::memory_order_relaxed);
+				it = aliases.emplace(msg->get_topic(), alias).first;
+				msg->set_properties(it->second.props);	//establishes alias, topic is kept
+				props_len += ALIAS_LEN;
 			}
-			else std::cout << "Valve received invalid command" << std::endl;
-		}
-
-		else if(topic == "thermostat/cmd"){
-			std::stringstream stream;
-			stream << msg->to_string();
-			std::string cmd = stream.str();
-			if(cmd.substr(0, 4) == "set "){
-				try{
-					int val = stoi(cmd.substr(4, cmd.length() - 4));
-					if(val > -50 && val < 50){
-						std::cout << "Thermostat received valid set command" << std::endl;
-						cmd_ts = {val};
-					}
-					else std::cout << "Thermostat received set command with value out of range" << std::endl;
-				}
-				catch(std::invalid_argument){
-					std::cout << "Thermostat received invalid set value" << std::endl;
-				}
+			else if(it != aliases.end()){
+				msg->set_properties(it->second.props);
+				msg->set_topic(mqtt::string_ref(std::string()));
+				topic_len = 0;
+				props_len += ALIAS_LEN;
 			}
-			else std::cout << "Thermostat received invalid command" << std::endl;
+			else if(msg->get_properties().empty() && !base.empty()) msg->set_properties(base);
 		}
+		else if(v5 && !base.empty() && msg->get_properties().empty()) msg->set_properties(base);
+
+		size_t payload_len = msg->get_payload_ref().size();
+		bytes.fetch_add(packet_size(topic_len, props_len, payload_len, msg->get_qos()), std::memory_order_relaxed);
+		full_bytes.fetch_add(packet_size(full_topic_len, base_len, payload_len, msg->get_qos()), std::memory_order_relaxed);
+		messages.fetch_add(1, std::memory_order_relaxed);
 	}
 
-	void delivery_complete(mqtt::delivery_token_ptr tok) override
+	/** @return Estimated average size of sent PUBLISH packet in bytes */
+	double bytes_per_message(void) const
 	{
-		std::cout << "Delivered token: " << tok->get_message_id() << std::endl;
+		uint64_t n = messages.load(std::memory_order_relaxed);
+		return n ? (double)bytes.load(std::memory_order_relaxed) / n : 0;
+	}
+
+	/** @return Estimated average size of PUBLISH packet if topics were sent in full */
+	double full_bytes_per_message(void) const
+	{
+		uint64_t n = messages.load(std::memory_order_relaxed);
+		return n ? (double)full_bytes.load(std::memory_order_relaxed) / n : 0;
+	}
+
+	/** @return Number of assigned aliases */
+	size_t alias_count(void) const
+	{
+		return assigned.load(std::memory_order_relaxed);
+	}
+
+private:
+	/** Encoded size of topic alias property */
+	static const size_t ALIAS_LEN = 3;
+
+	struct Alias{
+		int id;
+		mqtt::properties props;
+	};
+
+	bool v5;
+	int alias_max = 0;
+	mqtt::properties base;
+	size_t base_len = 0;
+	std::unordered_map<std::string, Alias> aliases;
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> full_bytes{0};
+	std::atomic<uint64_t> messages{0};
+	std::atomic<size_t> assigned{0};
+
+	/** @return Size of variable byte integer */
+	static size_t varint_size(size_t value)
+	{
+		size_t len = 1;
+		while(value >= 128){
+			value /= 128;
+			len++;
+		}
+		return len;
+	}
+
+	/** @return Size of PUBLISH packet on the wire as encoded by MQTT specification */
+	size_t packet_size(size_t topic_len, size_t props_len, size_t payload_len, int qos) const
+	{
+		size_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + payload_len;
+		if(v5) remaining += varint_size(props_len) + props_len;
+		return 1 + varint_size(remaining) + remaining;
 	}
 };
 
 
 //////////////////////////////////////////   SENSORS   //////////////////////////////////////////
+/** Function formats unsigned integer without allocation
+ *  @param out Output buffer, at least 20 characters
+ *  @param value Value to format
+ *  @return Number of written characters
+ */
+size_t format_uint(char* out, uint64_t value)
+{
+	char tmp[20];
+	size_t len = 0;
+	do{
+		tmp[len++] = '0' + value % 10;
+		value /= 10;
+	}while(value);
+	for(size_t i = 0; i < len; i++) out[i] = tmp[len - i - 1];
+	return len;
+}
+
+/** Function formats integer without allocation
+ *  @param out Output buffer, at least 21 characters
+ *  @param value Value to format
+ *  @return Number of written characters
+ */
+size_t format_int(char* out, int64_t value)
+{
+	if(value >= 0) return format_uint(out, value);
+	out[0] = '-';
+	return format_uint(out + 1, -(uint64_t)value) + 1;
+}
+
+/** Function formats float rounded to one decimal without allocation
+ *  @param out Output buffer, at least 24 characters
+ *  @param value Value to format
+ *  @return Number of written characters
+ */
+size_t format_fixed1(char* out, float value)
+{
+	int64_t tenths = std::llround(value * 10);
+	size_t len = 0;
+	if(tenths < 0){
+		out[len++] = '-';
+		tenths = -tenths;
+	}
+	len += format_uint(out + len, tenths / 10);
+	out[len++] = '.';
+	out[len++] = '0' + tenths % 10;
+	return len;
+}
+
+/**
+ * Class creating messages of one sensor, payloads are formatted into fixed buffer without streams and
+ * all messages share one topic string, only the message object and its payload are allocated per message
+ */
+class MessageWriter
+{
+public:
+	/** Constructor
+	 *  @param topic Name of topic to publish to
+	 */
+	explicit MessageWriter(const char* topic) : topic(std::string(topic)) {}
+
+	/** @param value Integer value
+	 *  @return Message with formatted value
+	 */
+	mqtt::message_ptr make_int(int value)
+	{
+		size_t len = header();
+		len += format_int(buf + len, value);
+		return make(buf, len);
+	}
+
+	/** @param value Float value
+	 *  @return Message with value formatted to one decimal
+	 */
+	mqtt::message_ptr make_float(float value)
+	{
+		size_t len = header();
+		len += format_fixed1(buf + len, value);
+		return make(buf, len);
+	}
+
+	/** @param text Short text payload
+	 *  @return Message with text payload
+	 */
+	mqtt::message_ptr make_text(const char* text)
+	{
+		size_t len = header();
+		size_t text_len = std::min(strlen(text), sizeof(buf) - len);
+		memcpy(buf + len, text, text_len);
+		return make(buf, len + text_len);
+	}
+
+	/** @param payload Immutable shared buffer, referenced by the message without copying
+	 *  @return Message with shared payload
+	 */
+	mqtt::message_ptr make_shared(const mqtt::binary_ref& payload)
+	{
+		size_t len = header();
+		if(len == 0) return mqtt::make_message(topic, payload, sensor_qos, false);
+		return mqtt::make_message(topic, mqtt::binary_ref(std::string(buf, len) + payload.str()), sensor_qos, false);
+	}
+
+private:
+	mqtt::string_ref topic;
+	uint64_t seq = 0;
+	char buf[96];
+
+	/** Function writes latency header into buffer in latency mode
+	 *  @return Length of header
+	 */
+	size_t header(void)
+	{
+		if(!latency_mode) return 0;
+		size_t len = LATENCY_HEADER_PREFIX.copy(buf, LATENCY_HEADER_PREFIX.size());
+		len += format_uint(buf + len, seq++);
+		buf[len++] = ':';
+		len += format_uint(buf + len, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count());
+		buf[len++] = ';';
+		return len;
+	}
+
+	/** Function creates message of sensor topic, the message is owned by publisher once queued
+	 *  @param payload Formatted payload
+	 *  @param len Length of payload
+	 *  @return New message
+	 */
+	mqtt::message_ptr make(const char* payload, size_t len)
+	{
+		return mqtt::make_message(topic, payload, len, sensor_qos, false);
+	}
+};
+
 /** Function simulating a sensor returning integer values
  *  @param Q Queue to push created messages to
  *  @param topic Name of topic to publish to
  *  @param min Minimum generated integer value
  *  @param max Maximum generated integer value
  *  @param period Time period between messages
+ *  @param rng Random generator of sensor
  */
-void intsensor(SafeQueue * Q, const char* topic, const int min, const int max, const int period)
+void intsensor(SafeQueue * Q, const char* topic, const int min, const int max, const int period, Random rng)
 {
-	srand(time(0));
 	int range;
 	if(min < 0 && max >= 0) range = max - min;
 	else if(min < 0 && max < 0) range = -1*(max - min);
@@ -143,11 +728,12 @@ void intsensor(SafeQueue * Q, const char* topic, const int min, const int max, c
 	int step = range / 50;	//defines value by which the result changes each iteration 
 	step = (step > 0)? step : 1;
 
-	int value = std::rand() % (range + 1) + min;	//set initial value in range
+	int value = rng.uniform(range + 1) + min;	//set initial value in range
 
+	MessageWriter writer(topic);
 	mqtt::message_ptr msg;
 	while(!halt.load()){
-		if(rand() % 2){
+		if(rng.coin()){
 			if(value >= max) value -= step;	//stay in range
 			else value += step;
 		}
@@ -155,7 +741,7 @@ void intsensor(SafeQueue * Q, const char* topic, const int min, const int max, c
 			if(value <= min) value += step;	//stay in range
 			else value -= step;
 		}
-		msg = mqtt::make_message(topic, std::to_string(value));
+		msg = writer.make_int(value);
 		Q->enqueue(msg);
 		std::this_thread::sleep_for(std::chrono::milliseconds(period));
 	}
@@ -167,10 +753,10 @@ void intsensor(SafeQueue * Q, const char* topic, const int min, const int max, c
  *  @param min Minimum generated float value
  *  @param max Maximum generated float value
  *  @param period Time period between messages
+ *  @param rng Random generator of sensor
  */
-void floatsensor(SafeQueue * Q, const char* topic, const float min, const float max, const int period)
+void floatsensor(SafeQueue * Q, const char* topic, const float min, const float max, const int period, Random rng)
 {
-	srand(time(0));
 	float range;
 	if(min < 0 && max >= 0) range = max - min;
 	else if(min < 0 && max < 0) range = -1*(max - min);
@@ -180,13 +766,13 @@ void floatsensor(SafeQueue * Q, const char* topic, const float min, const float
 	step = ((float )((int)(step * 10))) / 10;	//round to one decimal
 	step = (step > 0.1)? step : 0.1;
 
-	float value = min + static_cast <float> (rand()) / ( static_cast <float> (RAND_MAX/(range)));
+	float value = min + rng.uniform_float() * range;
 	value = ((float )((int)(value * 10))) / 10;	//set initial value in range
 
-	std::stringstream stream;
+	MessageWriter writer(topic);
 	mqtt::message_ptr msg;
 	while(!halt.load()){
-		if(rand() % 2){
+		if(rng.coin()){
 			if(value >= max) value -= step;	//stay in range
 				value += step;
 		}
@@ -195,10 +781,8 @@ void floatsensor(SafeQueue * Q, const char* topic, const float min, const float
 			else value -= step;
 		}
 
-		stream << std::fixed << std::setprecision(1) << value;	//format
-		msg = mqtt::make_message(topic, stream.str());
+		msg = writer.make_float(value);
 		Q->enqueue(msg);
-		stream.str(std::string());	//empty stream
 		std::this_thread::sleep_for(std::chrono::milliseconds(period));
 	}
 }
@@ -208,250 +792,564 @@ void floatsensor(SafeQueue * Q, const char* topic, const float min, const float
  *  @param topic Name of topic to publish to
  *  @param period_min Minimum time period between state change
  *  @param period_max Maximum time period between state change
+ *  @param rng Random generator of sensor
  */
-void door_switch(SafeQueue * Q, const char* topic, const int period_min, const int period_max)
+void door_switch(SafeQueue * Q, const char* topic, const int period_min, const int period_max, Random rng)
 {
-	mqtt::message_ptr msg = mqtt::make_message(topic, "closed");
+	MessageWriter writer(topic);
+	mqtt::message_ptr msg = writer.make_text("closed");
 	bool opened = false;	//state of door switch
 	Q->enqueue(msg);	//publish initial state
 
 	while(!halt.load()){
-		std::this_thread::sleep_for(std::chrono::milliseconds(rand() % (period_max - period_min + 1) + period_min));
+		std::this_thread::sleep_for(std::chrono::milliseconds(rng.uniform(period_max - period_min + 1) + period_min));
 		if(opened){
-			msg = mqtt::make_message(topic, "closed");
+			msg = writer.make_text("closed");
 			opened = false;
 		}
 		else{
-			msg = mqtt::make_message(topic, "opened");
+			msg = writer.make_text("opened");
 			opened = true;
 		}
 		Q->enqueue(msg);
 	}
 }
 
-/** Function simulating a valve which can be controlled using commands "open" and "close" received in topic valve/cmd
+/** Function simulating a valve which can be controlled using commands "open" and "close" received in its command topic
  *  @param Q Queue to push created messages to
  *  @param topic Name of topic to publish to
+ *  @param mailbox Mailbox receiving commands of valve
  */
-void valve(SafeQueue * Q, const char* topic)
+void valve(SafeQueue * Q, const char* topic, Mailbox* mailbox)
 {
-	mqtt::message_ptr msg = mqtt::make_message(topic, "closed");
+	MessageWriter writer(topic);
+	mqtt::message_ptr msg = writer.make_text("closed");
 	Q->enqueue(msg);	//publish initial state
 
-	int cmd;
+	std::string cmd;
 	while(!halt.load()){
-		while(!halt.load()){
-			cmd = cmd_valve.load();
-			if(cmd == 1){
-				msg = mqtt::make_message(topic, "opened");
-				cmd_valve = {-1};
-				break;
-			}
-			else if(cmd == 0){
-				msg = mqtt::make_message(topic, "closed");
-				cmd_valve = {-1};
-				break;
-			}
-			std::this_thread::sleep_for(std::chrono::milliseconds(1000));	//check for comand cooldown
+		if(!mailbox->wait(cmd, std::chrono::milliseconds(1000))) continue;	//recheck halt
+		if(cmd == "open"){
+			logger.log(Logger::INFO, "Valve %s received open command", topic);
+			Q->enqueue(writer.make_text("opened"));
 		}
-		Q->enqueue(msg);
+		else if(cmd == "close"){
+			logger.log(Logger::INFO, "Valve %s received close command", topic);
+			Q->enqueue(writer.make_text("closed"));
+		}
+		else logger.log(Logger::WARN, "Valve %s received invalid command", topic);
+	}
+}
+
+/** Function parses thermostat command "set <value>"
+ *  @param cmd Received command
+ *  @param target Output requested value, -50 < value < 50
+ *  @return True if command is valid
+ */
+bool parse_thermostat_cmd(const std::string& cmd, int& target)
+{
+	if(cmd.substr(0, 4) != "set "){
+		logger.log(Logger::WARN, "Thermostat received invalid command");
+		return false;
+	}
+	try{
+		int val = stoi(cmd.substr(4));
+		if(val > -50 && val < 50){
+			logger.log(Logger::INFO, "Thermostat received valid set command");
+			target = val;
+			return true;
+		}
+		logger.log(Logger::WARN, "Thermostat received set command with value out of range");
+	}
+	catch(const std::exception&){
+		logger.log(Logger::WARN, "Thermostat received invalid set value");
 	}
+	return false;
 }
 
-/** Function simulating a thermostat which can be controlled using command "set <value>" received in topic thermostat/cmd
+/** Function simulating a thermostat which can be controlled using command "set <value>" received in its command topic
  *  @param Q Queue to push created messages to
  *  @param topic Name of topic to publish to
  *  @param min Initial minimum integer value, min > -50
  *  @param max Initial maximum integer value, max < 50
  *  @param period Time period between messages
+ *  @param rng Random generator of sensor
+ *  @param mailbox Mailbox receiving commands of thermostat
  */
-void thermostat(SafeQueue * Q, const char* topic, const int min, const int max, const int period)
+void thermostat(SafeQueue * Q, const char* topic, const int min, const int max, const int period, Random rng, Mailbox* mailbox)
 {
-	srand(time(0));
 	int range;
 	if(min < 0 && max >= 0) range = max - min;
 	else if(min < 0 && max < 0) range = -1*(max - min);
 	else range = max - min;
 
-	int cmd = std::rand() % (range + 1) + min;	//set initial value in range
-	int value = cmd;	//state of thermostat
-	mqtt::message_ptr msg = mqtt::make_message(topic, std::to_string(cmd));
-	Q->enqueue(msg);
+	int target = rng.uniform(range + 1) + min;	//set initial value in range
+	int value = target;	//state of thermostat
+	MessageWriter writer(topic);
+	Q->enqueue(writer.make_int(value));
 
+	std::string cmd;
+	auto next_step = std::chrono::steady_clock::now();
 	while(!halt.load()){
-		cmd = cmd_ts.load();
-		if(cmd > -50 && cmd < 50){
-			while(!halt.load() && value != cmd){
-				if(cmd_ts.load() != cmd) cmd = cmd_ts.load();
-
-				if(value < cmd) value++;
-				else if(value > cmd) value--;
-				else break;
-
-				msg = mqtt::make_message(topic, std::to_string(value));
-				Q->enqueue(msg);
-				std::this_thread::sleep_for(std::chrono::milliseconds(period));
-			}
+		auto now = std::chrono::steady_clock::now();
+		if(value != target && now >= next_step){
+			value += (value < target) ? 1 : -1;
+			Q->enqueue(writer.make_int(value));
+			next_step = now + std::chrono::milliseconds(period);
+			continue;
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));	//check for comand cooldown
+		//wait for command, while value is changing only until next step, at least 1 ms so truncated wait does not spin
+		auto timeout = (value != target) ? std::max(std::chrono::milliseconds(1),
+		                                            std::chrono::duration_cast<std::chrono::milliseconds>(next_step - now))
+		                                 : std::chrono::milliseconds(1000);
+		if(mailbox->wait(cmd, timeout)) parse_thermostat_cmd(cmd, target);
 	}
 }
 
 /** Function simulating a camera which publishes new image every period
  *  @param Q Queue to push created messages to
  *  @param topic Name of topic to publish to
- *  @param file_list List of files to cycle through for publishing
+ *  @param images Preloaded images to cycle through for publishing
  *  @param period Time period between messages
  */
-void camera(SafeQueue * Q, const char* topic, const std::vector<std::string> file_list, const int period)
+void camera(SafeQueue * Q, const char* topic, const std::vector<mqtt::binary_ref> images, const int period)
 {
+	MessageWriter writer(topic);
 	while(!halt.load()){
-		for(auto &it: file_list){
+		for(auto &it: images){
 			if(halt.load()) break;
-			std::ifstream infile("../sim/"+it, std::ios::binary);
-			std::string content((std::istreambuf_iterator<char>(infile)), (std::istreambuf_iterator<char>()));
+			Q->enqueue(writer.make_shared(it));
+			std::this_thread::sleep_for(std::chrono::milliseconds(period));
+		}
+	}
+}
 
-			mqtt::message_ptr msg = mqtt::make_message(topic, content);
-			Q->enqueue(msg);
+/** Function replays recorded capture file, messages keep recorded topic, payload, QoS and retain flag
+ *  @param Q Queue to push created messages to
+ *  @param capture Opened capture file
+ *  @param speed Replay speed, 1 = original timing, 10 = ten times faster, 0 = as fast as possible
+ *  @param end_marker Enqueue empty message after last record to stop publisher
+ */
+void replay(SafeQueue * Q, CaptureReader * capture, const double speed, const bool end_marker)
+{
+	const size_t BACKLOG = 10000;	//maximum queued messages, limits memory when replaying as fast as possible
+	CaptureRecord record;
+	auto start = std::chrono::steady_clock::now();
+	int64_t first = -1;
+	uint64_t count = 0;
+	while(!halt.load() && capture->next(record)){
+		if(first < 0) first = record.time_ns;
+		if(speed > 0){
+			auto offset = std::chrono::nanoseconds(static_cast<int64_t>((record.time_ns - first) / speed));
+			if(!sleep_until_or_halt(start + offset)) break;
+		}
+		while(Q->size() > BACKLOG && !halt.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(period));
+		Q->enqueue(mqtt::make_message(std::string(record.topic, record.topic_len), record.payload, record.payload_len,
+		                              record.qos, record.retained));
+		count++;
+	}
+	logger.log(Logger::INFO, "Replay finished after %llu messages", (unsigned long long)count);
+	if(end_marker) Q->enqueue(nullptr);
+}
+
+/** Function loads camera images into immutable buffers shared by all messages and cameras
+ *  @param file_list Names of image files in sim directory
+ *  @param cache Already loaded images, new images are added
+ *  @param images Output list of image buffers in order of file_list
+ *  @return True if all files were loaded
+ */
+bool load_images(const std::vector<std::string>& file_list, std::map<std::string, mqtt::binary_ref>& cache, std::vector<mqtt::binary_ref>& images)
+{
+	for(auto &it: file_list){
+		auto cached = cache.find(it);
+		if(cached == cache.end()){
+			std::ifstream infile("../sim/"+it, std::ios::binary | std::ios::ate);
+			if(!infile.is_open()){
+				std::cerr << "ERROR: Could not open camera image " << it << ".\n";
+				return false;
+			}
+			std::string content(infile.tellg(), '\0');
+			infile.seekg(0);
+			infile.read(&content[0], content.size());
+			cached = cache.emplace(it, mqtt::binary_ref(std::move(content))).first;
 		}
+		images.push_back(cached->second);
 	}
+	return true;
 }
 
 
-//////////////////////////////////////////   MAIN   //////////////////////////////////////////
+//////////////////////////////////////////   CONFIGURATION   //////////////////////////////////////////
 /**
- * Main body of the program
+ * Parameters of one simulated sensor instance
  */
-int main(){
-	int QOS, MSG_CNT, SERVER_PORT, THERM_MIN, THERM_MAX, THERM_PER, HYGRO_MIN, HYGRO_MAX, HYGRO_PER, WATT_MIN, WATT_MAX, WATT_PER, TS_MIN, TS_MAX, TS_PER, DS_PER_MIN, DS_PER_MAX, PIR_PER, I_PER, Q_PER, CAM_PER;
-	float PIR_MIN, PIR_MAX, I_MIN, I_MAX, Q_MIN, Q_MAX;
-	std::string SERVER_ADDRESS, CLIENT_ID;
-	std::vector <std::string> CAM_IMG;
+struct SensorConfig
+{
+	std::string type;	//int, float, door, valve, thermostat or camera
+	std::string topic;
+	float min = 0;
+	float max = 0;
+	int period = 1000;
+	int period_max = 0;	//door switch only
+	std::vector<std::string> images;	//camera only
+	std::string cmd_topic;	//valve and thermostat only
+	std::string cmd_filter;	//subscription filter covering cmd_topic
+};
 
-	//Load configuration
-	std::ifstream file ("../sim/traffic.cfg");
-	if(file.is_open()){
-		std::string line;
-		while(getline(file, line)){
-			line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
-			if(line[0] == '#' || line.empty()) continue;
-			auto delimiter = line.find("=");
-			auto name = line.substr(0, delimiter);
-			auto value = line.substr(delimiter + 1);
-			try{
-				if(!name.compare("SERVER_ADDRESS")) SERVER_ADDRESS = value;
-				else if(!name.compare("CLIENT_ID")) CLIENT_ID = value;
-				else if(!name.compare("QOS")) QOS = stoi(value);
-				else if(!name.compare("MSG_CNT")) MSG_CNT = stoi(value);
-				else if(!name.compare("SERVER_PORT")) SERVER_PORT = stoi(value);
-				else if(!name.compare("THERM_MIN")) THERM_MIN = stoi(value);
-				else if(!name.compare("THERM_MAX")) THERM_MAX = stoi(value);
-				else if(!name.compare("THERM_PER")) THERM_PER = stoi(value);
-				else if(!name.compare("HYGRO_MIN")) HYGRO_MIN = stoi(value);
-				else if(!name.compare("HYGRO_MAX")) HYGRO_MAX = stoi(value);
-				else if(!name.compare("HYGRO_PER")) HYGRO_PER = stoi(value);
-				else if(!name.compare("WATT_MIN")) WATT_MIN = stoi(value);
-				else if(!name.compare("WATT_MAX")) WATT_MAX = stoi(value);
-				else if(!name.compare("WATT_PER")) WATT_PER = stoi(value);
-				else if(!name.compare("TS_MIN")) TS_MIN = stoi(value);
-				else if(!name.compare("TS_MAX")) TS_MAX = stoi(value);
-				else if(!name.compare("TS_PER")) TS_PER = stoi(value);
-				else if(!name.compare("DS_PER_MIN")) DS_PER_MIN = stoi(value);
-				else if(!name.compare("DS_PER_MAX")) DS_PER_MAX = stoi(value);
-				else if(!name.compare("PIR_MIN")) PIR_MIN = stof(value);
-				else if(!name.compare("PIR_MAX")) PIR_MAX = stof(value);
-				else if(!name.compare("PIR_PER")) PIR_PER = stoi(value);
-				else if(!name.compare("I_MIN")) I_MIN = stof(value);
-				else if(!name.compare("I_MAX")) I_MAX = stof(value);
-				else if(!name.compare("I_PER")) I_PER = stoi(value);
-				else if(!name.compare("Q_MIN")) Q_MIN = stof(value);
-				else if(!name.compare("Q_MAX")) Q_MAX = stof(value);
-				else if(!name.compare("Q_PER")) Q_PER = stoi(value);
-				else if(!name.compare("CAM_PER")) CAM_PER = stoi(value);
-				else if(!name.compare("CAM_IMG")){
-					size_t start, end = 0;
-					while ((start = value.find_first_not_of(',', end)) != std::string::npos){
-						end = value.find(',', start);
-						CAM_IMG.push_back(value.substr(start, end - start));
-					}
-				}
-				else{
-					std::cerr << "ERROR: Unrecognized option " << name << " in configuration file.";
-					return 1;
+/**
+ * Sensor template, named sensor type with default parameters
+ */
+struct SensorTemplate
+{
+	std::string type;
+	std::vector<std::pair<std::string, std::string>> params;
+};
+
+/** Function removes leading and trailing white space, spaces inside are kept
+ *  @param value String to trim
+ *  @return Trimmed string
+ */
+std::string trim(const std::string& value)
+{
+	auto start = value.find_first_not_of(" \t\r\n");
+	if(start == std::string::npos) return std::string();
+	auto end = value.find_last_not_of(" \t\r\n");
+	return value.substr(start, end - start + 1);
+}
+
+/** Function splits string by delimiter and trims parts, empty parts are skipped
+ *  @param value String to split
+ *  @param delimiter Delimiting character
+ *  @return List of parts
+ */
+std::vector<std::string> split(const std::string& value, char delimiter)
+{
+	std::vector<std::string> parts;
+	size_t start, end = 0;
+	while((start = value.find_first_not_of(delimiter, end)) != std::string::npos){
+		end = value.find(delimiter, start);
+		std::string part = trim(value.substr(start, end - start));
+		if(!part.empty()) parts.push_back(part);
+	}
+	return parts;
+}
+
+/** Function evaluates numeric parameter for one instance, value "a..b" is spread linearly across instances
+ *  @param value Parameter value
+ *  @param i Index of instance
+ *  @param count Number of instances
+ *  @return Value for instance i
+ */
+float instance_value(const std::string& value, int i, int count)
+{
+	auto range = value.find("..");
+	if(range == std::string::npos) return stof(value);
+	float from = stof(value.substr(0, range));
+	float to = stof(value.substr(range + 2));
+	if(count < 2) return from;
+	return from + (to - from) * i / (count - 1);
+}
+
+/** Function expands command topic pattern of controllable device, levels containing {i} become + in subscription filter
+ *  @param pattern Command topic pattern
+ *  @param i Index of instance
+ *  @param config Output sensor instance
+ */
+void expand_cmd_topic(const std::string& pattern, int i, SensorConfig& config)
+{
+	config.cmd_topic.clear();
+	config.cmd_filter.clear();
+	size_t start = 0;
+	while(true){
+		size_t end = pattern.find('/', start);
+		std::string level = pattern.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		bool instance = level.find("{i}") != std::string::npos;
+		for(auto pos = level.find("{i}"); pos != std::string::npos; pos = level.find("{i}")){
+			level.replace(pos, 3, std::to_string(i));
+		}
+		config.cmd_topic += level;
+		config.cmd_filter += instance ? "+" : level;
+		if(end == std::string::npos) break;
+		config.cmd_topic += '/';
+		config.cmd_filter += '/';
+		start = end + 1;
+	}
+}
+
+/** Function expands SENSOR line into sensor instances, every instance later runs in its own thread
+ *  Format: <type or template>, <topic pattern>[, <param>=<value>]... where {i} in topic pattern is replaced by instance index
+ *  @param value Value of SENSOR line
+ *  @param templates Defined sensor templates
+ *  @param sensors Output list of sensor instances
+ */
+void expand_sensor(const std::string& value, const std::map<std::string, SensorTemplate>& templates, std::vector<SensorConfig>& sensors)
+{
+	auto fields = split(value, ',');
+	if(fields.size() < 2) throw std::invalid_argument("missing sensor type or topic");
+
+	SensorTemplate sensor;
+	auto tmpl = templates.find(fields[0]);
+	if(tmpl != templates.end()) sensor = tmpl->second;
+	else sensor.type = fields[0];
+	if(sensor.type != "int" && sensor.type != "float" && sensor.type != "door" && sensor.type != "valve"
+	   && sensor.type != "thermostat" && sensor.type != "camera") throw std::invalid_argument("unknown sensor type " + sensor.type);
+
+	for(size_t i = 2; i < fields.size(); i++){
+		auto delimiter = fields[i].find('=');
+		if(delimiter == std::string::npos) throw std::invalid_argument("invalid parameter " + fields[i]);
+		sensor.params.emplace_back(trim(fields[i].substr(0, delimiter)), trim(fields[i].substr(delimiter + 1)));
+	}
+	// count may come from the template or the SENSOR line, the later one wins
+	int count = 1;
+	for(auto &param: sensor.params){
+		if(param.first == "count") count = stoi(param.second);
+	}
+	sensor.params.erase(std::remove_if(sensor.params.begin(), sensor.params.end(),
+	                                   [](const std::pair<std::string, std::string>& param){ return param.first == "count"; }),
+	                    sensor.params.end());
+	if(count < 1) throw std::invalid_argument("count has to be positive");
+
+	for(int i = 0; i < count; i++){
+		SensorConfig config;
+		std::string cmd;
+		config.type = sensor.type;
+		config.topic = fields[1];
+		for(auto pos = config.topic.find("{i}"); pos != std::string::npos; pos = config.topic.find("{i}")){
+			config.topic.replace(pos, 3, std::to_string(i));
+		}
+		for(auto &param: sensor.params){
+			if(param.first == "min") config.min = instance_value(param.second, i, count);
+			else if(param.first == "max") config.max = instance_value(param.second, i, count);
+			else if(param.first == "period") config.period = (int)instance_value(param.second, i, count);
+			else if(param.first == "period_max") config.period_max = (int)instance_value(param.second, i, count);
+			else if(param.first == "images") config.images = split(param.second, '|');
+			else if(param.first == "cmd") cmd = param.second;
+			else throw std::invalid_argument("unknown parameter " + param.first);
+		}
+		if(config.type == "valve" || config.type == "thermostat"){
+			expand_cmd_topic(cmd.empty() ? config.type + "/cmd" : cmd, i, config);
+		}
+		else if(!cmd.empty()) throw std::invalid_argument("only valve and thermostat accept commands");
+		if(config.period <= 0 || config.min > config.max) throw std::invalid_argument("invalid range or period");
+		if(config.type == "door" && config.period_max < config.period) config.period_max = config.period;
+		sensors.push_back(config);
+	}
+}
+
+/** Function loads configuration file
+ *  @param path Path to configuration file
+ *  @param options Output client options
+ *  @param sensors Output list of sensor instances
+ *  @param user_properties Output user properties of published messages
+ *  @return True on success
+ */
+bool load_config(const std::string& path, std::map<std::string, std::string>& options, std::vector<SensorConfig>& sensors,
+                 std::vector<std::pair<std::string, std::string>>& user_properties)
+{
+	std::ifstream file(path);
+	if(!file.is_open()){
+		std::cerr << "ERROR: Could not open configuration file.\n";
+		return false;
+	}
+	std::map<std::string, SensorTemplate> templates;
+	std::string line;
+	while(getline(file, line)){
+		//only white space around names and values is removed, values may contain spaces
+		line = trim(line);
+		if(line.empty() || line[0] == '#') continue;
+		auto delimiter = line.find("=");
+		auto name = trim(line.substr(0, delimiter));
+		auto value = trim(line.substr(delimiter + 1));
+		try{
+			if(!name.compare("SENSOR")) expand_sensor(value, templates, sensors);
+			else if(!name.compare("TEMPLATE")){
+				auto fields = split(value, ',');
+				if(fields.size() < 2) throw std::invalid_argument("missing template name or type");
+				SensorTemplate &tmpl = templates[fields[0]];
+				tmpl.type = fields[1];
+				tmpl.params.clear();
+				for(size_t i = 2; i < fields.size(); i++){
+					auto eq = fields[i].find('=');
+					if(eq == std::string::npos) throw std::invalid_argument("invalid parameter " + fields[i]);
+					tmpl.params.emplace_back(trim(fields[i].substr(0, eq)), trim(fields[i].substr(eq + 1)));
 				}
 			}
-			catch(const std::invalid_argument&){
-				std::cerr << "ERROR: Invalid value of " << name << " in configuration file.";
-				return 1;
+			else if(!name.compare("SERVER_ADDRESS") || !name.compare("CLIENT_ID") || !name.compare("QOS")
+			        || !name.compare("MSG_CNT") || !name.compare("LATENCY") || !name.compare("SERVER_PORT") || !name.compare("SEED")
+			        || !name.compare("LOG_LEVEL") || !name.compare("STATS_PERIOD")
+			        || !name.compare("REPLAY") || !name.compare("REPLAY_SPEED")
+			        || !name.compare("MQTT_VERSION") || !name.compare("TOPIC_ALIAS")) options[name] = value;
+			else if(!name.compare("USER_PROPERTY")){
+				auto eq = value.find('=');
+				if(eq == std::string::npos) throw std::invalid_argument("expected <name>=<value>");
+				user_properties.emplace_back(trim(value.substr(0, eq)), trim(value.substr(eq + 1)));
 			}
-			catch(const std::out_of_range&){
-				std::cerr << "ERROR: Invalid value of " << name << " in configuration file.";
-				return 1;
+			else{
+				std::cerr << "ERROR: Unrecognized option " << name << " in configuration file.\n";
+				return false;
 			}
 		}
+		catch(const std::exception& e){
+			std::cerr << "ERROR: Invalid value of " << name << " in configuration file: " << e.what() << "\n";
+			return false;
+		}
 	}
-	else{
-		std::cerr << "ERROR: Could not open configuration file.\n";
-		return 1;
-	}
-	SafeQueue Q;
+	return true;
+}
 
-	std::thread therm(intsensor, &Q, "thermometer", THERM_MIN, THERM_MAX, THERM_PER);
-	std::thread hygro(intsensor, &Q, "hygrometer", HYGRO_MIN, HYGRO_MAX, HYGRO_PER);
-	std::thread watt(intsensor, &Q, "wattmeter", WATT_MIN, WATT_MAX, WATT_PER);
 
-	std::thread pir(floatsensor, &Q, "PIR-sensor", PIR_MIN, PIR_MAX, PIR_PER);
-	std::thread iradar(floatsensor, &Q, "radar/in-phase", I_MIN, I_MAX, I_PER);
-	std::thread qradar(floatsensor, &Q, "radar/quadrature", Q_MIN, Q_MAX, Q_PER);
+//////////////////////////////////////////   MAIN   //////////////////////////////////////////
+/**
+ * Main body of the program
+ */
+int main(){
+	int QOS, MSG_CNT, STATS_PERIOD, MQTT_VERSION;
+	bool TOPIC_ALIAS;
+	double REPLAY_SPEED;
+	std::string REPLAY;
+	uint64_t SEED;
+	Logger::Level LOG_LEVEL = Logger::INFO;
+	std::string SERVER_ADDRESS, CLIENT_ID, SERVER_PORT;
+	std::map<std::string, std::string> options;
+	std::vector<SensorConfig> sensors;
+	std::vector<std::pair<std::string, std::string>> user_properties;
 
-	std::thread ds(door_switch, &Q, "door-switch", DS_PER_MIN, DS_PER_MAX);
-	std::thread valv(valve, &Q, "valve/state");
+	//Load configuration
+	if(!load_config("../sim/traffic.cfg", options, sensors, user_properties)) return 1;
+	try{
+		SERVER_ADDRESS = options.at("SERVER_ADDRESS");
+		SERVER_PORT = options.at("SERVER_PORT");
+		CLIENT_ID = options.at("CLIENT_ID");
+		QOS = stoi(options.at("QOS"));
+		MSG_CNT = stoi(options.at("MSG_CNT"));
+		latency_mode = options.count("LATENCY") && stoi(options["LATENCY"]) != 0;
+		SEED = options.count("SEED") ? stoull(options["SEED"]) : 0;
+		if(SEED == 0) SEED = std::chrono::system_clock::now().time_since_epoch().count();
+		STATS_PERIOD = options.count("STATS_PERIOD") ? stoi(options["STATS_PERIOD"]) : 1000;
+		REPLAY = options.count("REPLAY") ? options["REPLAY"] : "";
+		REPLAY_SPEED = options.count("REPLAY_SPEED") ? stod(options["REPLAY_SPEED"]) : 1;
+		if(REPLAY_SPEED < 0) throw std::invalid_argument("REPLAY_SPEED");
+		sensor_qos = QOS;
+		MQTT_VERSION = options.count("MQTT_VERSION") ? stoi(options["MQTT_VERSION"]) : 3;
+		if(MQTT_VERSION != 3 && MQTT_VERSION != 5) throw std::invalid_argument("MQTT_VERSION");
+		TOPIC_ALIAS = options.count("TOPIC_ALIAS") && stoi(options["TOPIC_ALIAS"]) != 0;
+		if((TOPIC_ALIAS || !user_properties.empty()) && MQTT_VERSION != 5) throw std::invalid_argument("MQTT_VERSION");
+		if(options.count("LOG_LEVEL")){
+			const std::string levels[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+			auto level = std::find(std::begin(levels), std::end(levels), options["LOG_LEVEL"]);
+			if(level == std::end(levels)) throw std::invalid_argument("LOG_LEVEL");
+			LOG_LEVEL = static_cast<Logger::Level>(level - std::begin(levels));
+		}
+	}
+	catch(const std::exception&){
+		std::cerr << "ERROR: Missing or invalid client option in configuration file.\n";
+		return 1;
+	}
+	std::map<std::string, mqtt::binary_ref> image_cache;
+	std::vector<std::vector<mqtt::binary_ref>> cam_images(sensors.size());
+	for(size_t i = 0; i < sensors.size(); i++){
+		if(sensors[i].type == "camera" && !load_images(sensors[i].images, image_cache, cam_images[i])) return 1;
+	}
 
-	std::thread ts(thermostat, &Q, "thermostat/temp", TS_MIN, TS_MAX, TS_PER);
+	CaptureReader capture;
+	if(!REPLAY.empty() && !capture.open("../sim/" + REPLAY)){
+		std::cerr << "ERROR: Could not open capture file " << REPLAY << ".\n";
+		return 1;
+	}
 
-	std::thread cam(camera, &Q, "camera", CAM_IMG, CAM_PER);
+	SafeQueue Q;
+	CommandRouter router;
 
-	mqtt::async_client client(SERVER_ADDRESS+":"+std::to_string(SERVER_PORT), CLIENT_ID);
-	auto connOpts = mqtt::connect_options_builder()
-		.clean_session()
-		.finalize();
-	Callback cb;
+	bool v5 = MQTT_VERSION == 5;
+	mqtt::async_client client(SERVER_ADDRESS+":"+SERVER_PORT, CLIENT_ID,
+	                          mqtt::create_options(v5 ? MQTTVERSION_5 : MQTTVERSION_3_1_1));
+	auto connBuilder = mqtt::connect_options_builder();
+	if(v5) connBuilder.mqtt_version(MQTTVERSION_5).clean_start();
+	else connBuilder.clean_session();
+	auto connOpts = connBuilder.finalize();
+	PublishEncoder encoder(v5, user_properties);
+	Callback cb(router);
 	client.set_callback(cb);
 
-	mqtt::message_ptr msg;
+	std::atomic<uint64_t> published{0};
+	uint64_t last_published = 0;
+	logger.start(LOG_LEVEL, std::chrono::milliseconds(STATS_PERIOD), [&](double seconds){
+		uint64_t now_published = published.load();
+		char line[160];
+		int len = snprintf(line, sizeof(line), "%.0f msg/s, %zu in flight, %zu queued, %llu delivered, %llu log drops",
+		         (now_published - last_published) / seconds, client.get_pending_delivery_tokens().size(), Q.size(),
+		         (unsigned long long)cb.delivered.load(), (unsigned long long)logger.dropped());
+		if(len > 0 && (size_t)len < sizeof(line)){
+			if(TOPIC_ALIAS) snprintf(line + len, sizeof(line) - len, ", est. %.1f B/msg (%.1f without %zu aliases)",
+			                         encoder.bytes_per_message(), encoder.full_bytes_per_message(), encoder.alias_count());
+			else snprintf(line + len, sizeof(line) - len, ", est. %.1f B/msg", encoder.bytes_per_message());
+		}
+		last_published = now_published;
+		return std::string(line);
+	});
+	//sensors start only after the logger is configured, they log from the first message
+	std::vector<std::thread> threads;
+	threads.reserve(sensors.size());
+	for(size_t i = 0; i < sensors.size(); i++){
+		const SensorConfig &it = sensors[i];
+		const char* topic = it.topic.c_str();
+		Random rng(SEED, i);
+		if(it.type == "int") threads.emplace_back(intsensor, &Q, topic, (int)it.min, (int)it.max, it.period, rng);
+		else if(it.type == "float") threads.emplace_back(floatsensor, &Q, topic, it.min, it.max, it.period, rng);
+		else if(it.type == "door") threads.emplace_back(door_switch, &Q, topic, it.period, it.period_max, rng);
+		else if(it.type == "valve") threads.emplace_back(valve, &Q, topic, router.add(it.cmd_topic, it.cmd_filter));
+		else if(it.type == "thermostat") threads.emplace_back(thermostat, &Q, topic, (int)it.min, (int)it.max, it.period, rng,
+		                                                      router.add(it.cmd_topic, it.cmd_filter));
+		else if(it.type == "camera") threads.emplace_back(camera, &Q, topic, cam_images[i], it.period);
+	}
+	if(!REPLAY.empty()) threads.emplace_back(replay, &Q, &capture, REPLAY_SPEED, sensors.empty());
+	logger.log(Logger::INFO, "Started %zu sensors%s", sensors.size(), REPLAY.empty() ? "" : " and replay");
+
+	int rc = 0;
 	try{
 		mqtt::token_ptr conntok = client.connect(connOpts);
 		conntok->wait();
+		int alias_max = 0;
+		if(TOPIC_ALIAS){
+			const mqtt::properties& connack = conntok->get_connect_response().get_properties();
+			if(connack.contains(mqtt::property::TOPIC_ALIAS_MAXIMUM)){
+				alias_max = mqtt::get<int>(connack, mqtt::property::TOPIC_ALIAS_MAXIMUM);
+			}
+			if(alias_max == 0) logger.log(Logger::WARN, "Server does not accept topic aliases");
+		}
+		encoder.enable_aliases(alias_max);
 
-		client.subscribe("valve/cmd", QOS);
-		client.subscribe("thermostat/cmd", QOS);
+		for(auto &filter: router.filters()) client.subscribe(filter, QOS);
 
-		while(MSG_CNT > 0){
-			msg = Q.dequeue();
-			msg->set_qos(QOS);
-			client.publish(msg);
-			MSG_CNT--;
+		//messages queued meanwhile are taken under one lock
+		std::vector<mqtt::message_ptr> batch;
+		bool finished = false;
+		while(MSG_CNT > 0 && !finished){
+			Q.dequeue_batch(batch, std::min(MSG_CNT, PUBLISH_BATCH));
+			for(auto &msg: batch){
+				if(!msg){	//replay finished
+					finished = true;
+					break;
+				}
+				encoder.prepare(msg);
+				client.publish(msg);
+				published.fetch_add(1, std::memory_order_relaxed);
+				MSG_CNT--;
+			}
+			batch.clear();
 		}
-		halt = true;
+		client.disconnect();
 	}
 	catch(const mqtt::exception& exc){
-		std::cerr << exc.what() << std::endl;
-		return 1;
+		logger.log(Logger::ERROR, "%s", exc.what());
+		rc = 1;
 	}
 
-	client.disconnect();
-	therm.join();
-	hygro.join();
-	watt.join();
-	pir.join();
-	iradar.join();
-	qradar.join();
-	ds.join();
-	valv.join();
-	ts.join();
-	cam.join();
+	halt = true;
+	router.close();
+	for(auto &it: threads) it.join();
+	logger.stop();
 
-	return 0;
+	return rc;
 }
@@ -0,0 +1,337 @@
+/** @file brokerTest.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Round trip test of the loopback broker over raw sockets: CONNECT, SUBSCRIBE with + and # wildcards,
+ *  retained message, topic alias and subscription identifiers. Exits with nonzero status on failure.
+ */
+
+#include "Broker.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Number of failed checks */
+int failures = 0;
+
+/**
+ * Reports failed check
+ * @param condition Checked condition
+ * @param what Description of the check
+ */
+void check(bool condition, const std::string& what)
+{
+    if (!condition){
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * Appends MQTT variable byte integer
+ * @param out Output buffer
+ * @param value Encoded value
+ */
+void put_varint(std::string& out, uint32_t value)
+{
+    do {
+        uint8_t byte = value % 128;
+        value /= 128;
+        out += static_cast<char>(value ? byte | 0x80 : byte);
+    } while (value);
+}
+
+/**
+ * Appends length prefixed string
+ * @param out Output buffer
+ * @param value Encoded string
+ */
+void put_string(std::string& out, const std::string& value)
+{
+    out += static_cast<char>(value.size() >> 8);
+    out += static_cast<char>(value.size() & 0xFF);
+    out += value;
+}
+
+/** Received PUBLISH packet */
+struct Publish{
+    std::string topic;
+    std::string payload;
+    bool retain = false;
+    std::vector<uint32_t> subscription_ids;
+};
+
+/** MQTT 5 client speaking raw packets */
+class TestClient{
+    int fd = -1;
+    std::string in;
+
+public:
+    /**
+     * Connects socket to broker and completes CONNECT
+     * @param port Port of broker on localhost
+     * @param id Client identifier
+     */
+    TestClient(uint16_t port, const std::string& id)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+            throw std::runtime_error("Cannot connect to broker");
+        }
+        std::string body;
+        put_string(body, "MQTT");
+        body += '\x05';  // Protocol level
+        body += '\x02';  // Clean start
+        body += '\x00';
+        body += '\x3C';  // Keep alive 60 s
+        body += '\x00';  // No properties
+        put_string(body, id);
+        send(0x10, body);
+        uint8_t type;
+        std::string connack;
+        check(receive(type, connack) && type == 0x20, id + ": CONNACK received");
+        check(connack.size() >= 2 && connack[1] == 0, id + ": connection accepted");
+    }
+
+    ~TestClient()
+    {
+        if (fd >= 0){
+            close(fd);
+        }
+    }
+
+    /**
+     * Sends packet
+     * @param fixed First byte of fixed header
+     * @param body Variable header and payload
+     */
+    void send(uint8_t fixed, const std::string& body)
+    {
+        std::string packet(1, static_cast<char>(fixed));
+        put_varint(packet, body.size());
+        packet += body;
+        size_t written = 0;
+        while (written < packet.size()){
+            ssize_t n = write(fd, packet.data() + written, packet.size() - written);
+            if (n <= 0){
+                throw std::runtime_error("Write to broker failed");
+            }
+            written += n;
+        }
+    }
+
+    /**
+     * Waits for next packet
+     * @param type Output first byte of fixed header
+     * @param body Output rest of packet
+     * @return False if no packet arrived within two seconds
+     */
+    bool receive(uint8_t& type, std::string& body)
+    {
+        while (true){
+            // Complete packet already buffered
+            size_t length = 0, pos = 1;
+            int shift = 0;
+            bool complete = false;
+            while (pos < in.size() && pos < 5){
+                uint8_t byte = in[pos++];
+                length |= size_t(byte & 0x7F) << shift;
+                shift += 7;
+                if (!(byte & 0x80)){
+                    complete = in.size() >= pos + length;
+                    break;
+                }
+            }
+            if (complete){
+                type = in[0];
+                body = in.substr(pos, length);
+                in.erase(0, pos + length);
+                return true;
+            }
+            pollfd descriptor{fd, POLLIN, 0};
+            if (poll(&descriptor, 1, 2000) <= 0){
+                return false;
+            }
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0){
+                return false;
+            }
+            in.append(buffer, n);
+        }
+    }
+
+    /**
+     * Subscribes filter with QoS 0 and waits for SUBACK
+     * @param packet_id Packet identifier
+     * @param filter Topic filter
+     * @param subscription_id Subscription identifier, 0 for none
+     */
+    void subscribe(uint16_t packet_id, const std::string& filter, uint32_t subscription_id)
+    {
+        std::string properties;
+        if (subscription_id){
+            properties += '\x0B';
+            put_varint(properties, subscription_id);
+        }
+        std::string body;
+        body += static_cast<char>(packet_id >> 8);
+        body += static_cast<char>(packet_id & 0xFF);
+        put_varint(body, properties.size());
+        body += properties;
+        put_string(body, filter);
+        body += '\x00';
+        send(0x82, body);
+        uint8_t type;
+        std::string suback;
+        check(receive(type, suback) && type == 0x90, "SUBACK of " + filter);
+        check(suback.size() >= 4 && uint8_t(suback.back()) == 0, "granted QoS 0 for " + filter);
+    }
+
+    /**
+     * Publishes QoS 0 message
+     * @param topic Topic name, empty if only alias is sent
+     * @param payload Payload
+     * @param retain Retain flag
+     * @param alias Topic alias, 0 for none
+     */
+    void publish(const std::string& topic, const std::string& payload, bool retain, uint16_t alias)
+    {
+        std::string properties;
+        if (alias){
+            properties += '\x23';
+            properties += static_cast<char>(alias >> 8);
+            properties += static_cast<char>(alias & 0xFF);
+        }
+        std::string body;
+        put_string(body, topic);
+        put_varint(body, properties.size());
+        body += properties;
+        body += payload;
+        send(retain ? 0x31 : 0x30, body);
+    }
+
+    /**
+     * Waits for next PUBLISH of QoS 0
+     * @param message Output message
+     * @return False if no PUBLISH arrived
+     */
+    bool next_publish(Publish& message)
+    {
+        uint8_t type;
+        std::string body;
+        if (!receive(type, body) || (type & 0xF0) != 0x30 || body.size() < 2){
+            return false;
+        }
+        message = Publish();
+        message.retain = type & 0x01;
+        size_t topic_length = uint8_t(body[0]) << 8 | uint8_t(body[1]);
+        message.topic = body.substr(2, topic_length);
+        size_t pos = 2 + topic_length;
+        size_t properties_length = 0;
+        int shift = 0;
+        while (pos < body.size()){
+            uint8_t byte = body[pos++];
+            properties_length |= size_t(byte & 0x7F) << shift;
+            shift += 7;
+            if (!(byte & 0x80)){
+                break;
+            }
+        }
+        size_t end = pos + properties_length;
+        // Only subscription identifiers are expected in forwarded messages
+        while (pos < end && body[pos] == '\x0B'){
+            pos++;
+            uint32_t id = 0;
+            shift = 0;
+            while (pos < end){
+                uint8_t byte = body[pos++];
+                id |= uint32_t(byte & 0x7F) << shift;
+                shift += 7;
+                if (!(byte & 0x80)){
+                    break;
+                }
+            }
+            message.subscription_ids.push_back(id);
+        }
+        // Order of identifiers is not defined by the protocol
+        std::sort(message.subscription_ids.begin(), message.subscription_ids.end());
+        check(pos == end, "only subscription identifiers in properties of " + message.topic);
+        message.payload = body.substr(end);
+        return true;
+    }
+};
+
+/**
+ * Main body of the test
+ */
+int main()
+{
+    Broker broker;
+    try {
+        broker.start("127.0.0.1", 0);
+    } catch (const std::runtime_error& error){
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    check(broker.port() != 0, "port assigned");
+
+    try {
+        TestClient publisher(broker.port(), "publisher");
+        publisher.publish("state/door", "open", true, 0);
+
+        TestClient subscriber(broker.port(), "subscriber");
+        Publish message;
+        subscriber.subscribe(1, "state/#", 0);
+        check(subscriber.next_publish(message), "retained message delivered");
+        check(message.topic == "state/door" && message.payload == "open" && message.retain,
+              "retained message content and flag");
+
+        subscriber.subscribe(2, "site/+/temp", 7);
+        subscriber.subscribe(3, "site/#", 9);
+
+        // First message sets alias 1, second sends only the alias
+        publisher.publish("site/a/temp", "21", false, 1);
+        publisher.publish("", "22", false, 1);
+        publisher.publish("site/a/hum", "50", false, 0);
+        const char* payloads[] = {"21", "22"};
+        for (const char* payload: payloads){
+            check(subscriber.next_publish(message), std::string("message ") + payload + " delivered");
+            check(message.topic == "site/a/temp" && message.payload == payload && !message.retain,
+                  std::string("topic of message ") + payload + " resolved from alias");
+            check(message.subscription_ids == std::vector<uint32_t>({7, 9}),
+                  std::string("both subscription identifiers of message ") + payload);
+        }
+        check(subscriber.next_publish(message), "message matching only # delivered");
+        check(message.topic == "site/a/hum" && message.subscription_ids == std::vector<uint32_t>({9}),
+              "only identifier of matching subscription");
+    } catch (const std::runtime_error& error){
+        std::cerr << error.what() << std::endl;
+        failures++;
+    }
+
+    BrokerStats stats = broker.stats();
+    check(stats.total_connections == 2, "two connections counted");
+    check(stats.received == 4, "four messages received");
+    broker.stop();
+
+    if (failures){
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Broker test passed" << std::endl;
+    return 0;
+}
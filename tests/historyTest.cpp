@@ -0,0 +1,72 @@
+/** @file historyTest.cpp
+ *  @author Radek Manak (xmanak20)
+ *  @author Branislav Brezani (xbreza01)
+ *
+ *  Checks that compressing a history message frees its payload although the search index still finds it.
+ *  Exits with nonzero status on failure.
+ */
+
+#include "Mqttclient.h"
+#include <iostream>
+#include <memory>
+#include <string>
+
+/** Number of failed checks */
+int failures = 0;
+
+/**
+ * Reports failed check
+ * @param condition Checked condition
+ * @param what Description of the check
+ */
+void check(bool condition, const std::string& what)
+{
+    if (!condition){
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * Main body of the test
+ */
+int main()
+{
+    const std::string text = "{\"room\": \"living room\", \"temperature\": 21.5}";
+    auto received_time = std::chrono::system_clock::now();
+
+    Searchindex search;
+    TopicMessage message;
+    search.set_resolver([&](const std::string& topic, std::chrono::time_point<std::chrono::system_clock> time){
+        return topic == "home/sensor" && time == message.received_time ? message.get_payload_ref() : mqtt::binary_ref();
+    });
+
+    mqtt::binary_ref payload(text);
+    std::weak_ptr<const std::string> buffer = payload.ptr();
+    message.received_time = received_time;
+    message.last_received_time = received_time;
+    message.mime_type = "text/plain";
+    message.payload = payload;
+    search.add("home/sensor", payload, received_time);
+    payload = mqtt::binary_ref();
+    check(buffer.use_count() == 1, "payload held only by history message");
+
+    auto block = std::make_shared<HistoryBlock>();
+    block->offsets = {0, static_cast<uint32_t>(text.size())};
+    block->compressed = qCompress(QByteArray(text.data(), int(text.size())));
+    message.compress_into(block, 0);
+    check(buffer.use_count() == 0, "payload freed after compression");
+    check(message.get_payload() == text, "payload decompressed from block");
+
+    auto results = search.search("living", 10);
+    check(results.size() == 1, "compressed message found by search");
+    check(!results.empty() && results.front().payload && results.front().payload.str() == text,
+          "payload of search result resolved from history");
+
+    if (failures){
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "History test passed" << std::endl;
+    return 0;
+}